@@ -130,10 +130,10 @@ public:
                              get_real_time_s(), get_sim_time_s(), get_sim_dt_s(),
                              fire_smoke_dt_factor, projectile_speed_factor,
                              20, 40,
+                             get_anim_count(1), 5, 5,
                              kpdp, &game_over);
       dungeon_engine->draw(sh, get_real_time_s(), get_sim_time_s(),
-                           get_anim_count(0), get_anim_count(1),
-                           5, 5);
+                           get_anim_count(0));
       sh.print_screen_buffer(Color16::Black);
 #endif
     }
@@ -195,6 +195,7 @@ private:
                              get_real_time_s(), get_sim_time_s(), get_sim_dt_s(),
                              fire_smoke_dt_factor, projectile_speed_factor,
                              20, 40,
+                             get_anim_count(1), 5, 5,
                              kpdp, &game_over);
       if (game_over)
         set_state_game_over();
@@ -203,8 +204,7 @@ private:
         draw_frame(sh, Color16::White);
       
       dungeon_engine->draw(sh, get_real_time_s(), get_sim_time_s(),
-                           get_anim_count(0), get_anim_count(1),
-                           5, 5,
+                           get_anim_count(0),
                            t8x::VerticalAlignment::CENTER, t8x::HorizontalAlignment::CENTER,
                            4, 0, framed_mode, use_gore);
     }
@@ -279,7 +279,7 @@ private:
     dungeon_engine->place_weapons(30, 25, 17, 13, 30, 20, 15, true, true);
     dungeon_engine->place_potions(80, 20, true, true);
     dungeon_engine->place_armour(25, 30, 20, 10, 40, 15, 10, true, true);
-    dungeon_engine->place_npcs(100, true);
+    dungeon_engine->place_npcs(100, true, GameEngine::get_curr_rnd_seed());
     dungeon.create_staircases(4);
     
     if (init)
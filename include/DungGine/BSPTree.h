@@ -109,8 +109,8 @@ namespace dung
     
     std::vector<Door*> doors;
     
-    bool_vector fog_of_war;
-    bool_vector light;
+    FogOfWarView fog_of_war; // Views into the planes of the BSPTree. Only bound for leaves.
+    BitPlaneView light;
     
     Staircase* staircase = nullptr;
     
@@ -257,10 +257,6 @@ namespace dung
             min_rnd_wall_padding = 0;
           num_tries++;
         } while (bb_leaf_room.r_len < min_room_length || bb_leaf_room.c_len < min_room_length);
-        
-        size_t surf_area = bb_leaf_room.r_len * bb_leaf_room.c_len;
-        fog_of_war.resize(surf_area, true);
-        light.resize(surf_area, false);
       }
       else
       {
@@ -281,6 +277,26 @@ namespace dung
         children[1]->collect_leaves(leaves);
     }
     
+    // Walks down the split planes to the leaf whose region contains pos.
+    // The regions of the children partition the region of the parent,
+    //   so there is at most one such leaf.
+    BSPNode* find_leaf(const RC& pos)
+    {
+      auto* node = this;
+      while (!node->is_leaf())
+      {
+        const auto& bb_1 = node->children[1]->bb_region;
+        bool in_ch_1 = false;
+        switch (node->orientation)
+        {
+          case Orientation::Vertical: in_ch_1 = pos.c >= bb_1.c; break;
+          case Orientation::Horizontal: in_ch_1 = pos.r >= bb_1.r; break;
+        }
+        node = node->children[in_ch_1 ? 1 : 0].get();
+      }
+      return node;
+    }
+    
     bool is_inside_room(const RC& pos, t8::BBLocation* location = nullptr) const
     {
       if (!is_leaf())
@@ -302,10 +318,9 @@ namespace dung
       if (!is_leaf())
         return true;
       auto local_pos = world_pos - bb_leaf_room.pos();
-      auto idx = local_pos.r * bb_leaf_room.c_len + local_pos.c;
-      if (math::in_range<int>(idx, 0, stlutils::sizeI(fog_of_war), Range::ClosedOpen))
-        return fog_of_war[idx];
-      return true;
+      if (!fog_of_war.in_bounds(local_pos.r, local_pos.c))
+        return true;
+      return fog_of_war.get(local_pos.r, local_pos.c);
     }
     
     bool is_in_light(const RC& world_pos)
@@ -313,57 +328,7 @@ namespace dung
       if (!is_leaf())
         return false;
       auto local_pos = world_pos - bb_leaf_room.pos();
-      auto idx = local_pos.r * bb_leaf_room.c_len + local_pos.c;
-      if (math::in_range<int>(idx, 0, stlutils::sizeI(light), Range::ClosedOpen))
-        return light[idx];
-      return false;
-    }
-    
-    void serialize(std::vector<std::string>& lines) const
-    {
-      if (is_leaf())
-      {
-        sg::write_var(lines, SG_WRITE_VAR(fog_of_war));
-        sg::write_var(lines, SG_WRITE_VAR(light));
-      }
-      else
-      {
-        if (children[0])
-          children[0]->serialize(lines);
-        if (children[1])
-          children[1]->serialize(lines);
-      }
-    }
-    
-    std::vector<std::string>::iterator deserialize(std::vector<std::string>::iterator it_line_begin,
-                                                   std::vector<std::string>::iterator it_line_end)
-    {
-      auto it_line = it_line_begin;
-      if (is_leaf())
-      {
-        auto Nfow = fog_of_war.size();
-        auto Nl = light.size();
-        assert(Nfow > 0);
-        assert(Nl > 0);
-        if (sg::read_var(&it_line, SG_READ_VAR(fog_of_war)))
-          assert(Nfow == fog_of_war.size());
-        ++it_line;
-        
-        if (sg::read_var(&it_line, SG_READ_VAR(light)))
-          assert(Nl == light.size());
-        ++it_line;
-        
-        return it_line;
-      }
-      else
-      {
-        if (children[0])
-          it_line = children[0]->deserialize(it_line, it_line_end);
-        if (children[1])
-          it_line = children[1]->deserialize(it_line, it_line_end);
-      }
-      
-      return it_line;
+      return light.get(local_pos.r, local_pos.c);
     }
   };
       
@@ -378,10 +343,21 @@ namespace dung
     
     std::vector<std::unique_ptr<Corridor>> corridors;
     std::vector<std::unique_ptr<Door>> doors;
+    std::vector<Door*> doors_raw; // Non-owning view of doors, kept in sync by create_doors().
     std::map<std::pair<BSPNode*, BSPNode*>, Corridor*, PtrPairLess<BSPNode>> room_corridor_map;
     
     Rectangle bb;
     
+    // Fog of war and light of the whole floor. The rooms and corridors hold views into them.
+    BitPlane m_fog_of_war;
+    BitPlane m_light;
+    
+    void bind_fields(BitPlaneView& fog_of_war, BitPlaneView& light, const Rectangle& bb_obj)
+    {
+      fog_of_war.bind(&m_fog_of_war, bb_obj.r, bb_obj.c, bb_obj.r_len, bb_obj.c_len);
+      light.bind(&m_light, bb_obj.r, bb_obj.c, bb_obj.r_len, bb_obj.c_len);
+    }
+    
   public:
     int id = global_bsp_tree_id++;
   
@@ -397,8 +373,11 @@ namespace dung
       m_root = BSPNode {};
       corridors.clear();
       doors.clear();
+      doors_raw.clear();
       room_corridor_map.clear();
       bb.clear();
+      m_fog_of_war.clear();
+      m_light.clear();
     }
     
     void generate(int world_size_rows, int world_size_cols,
@@ -428,9 +407,28 @@ namespace dung
       return { m_root.size_rows, m_root.size_cols };
     }
     
+    const BitPlane& get_fog_of_war_plane() const { return m_fog_of_war; }
+    const BitPlane& get_light_plane() const { return m_light; }
+    
+    // Grows whenever the fog of war or the light of the floor is written to.
+    uint64_t get_fields_generation() const
+    {
+      return m_fog_of_war.get_generation() + m_light.get_generation();
+    }
+    
+    BSPNode* find_leaf(const RC& pos)
+    {
+      return m_root.find_leaf(pos);
+    }
+    
     void pad_rooms(int min_rnd_wall_padding = 1, int max_rnd_wall_padding = 4)
     {
       m_root.pad_rooms(m_min_room_length, min_rnd_wall_padding, max_rnd_wall_padding);
+      
+      m_fog_of_war.reset(m_root.size_rows, m_root.size_cols, true);
+      m_light.reset(m_root.size_rows, m_root.size_cols, false);
+      for (auto* leaf : fetch_leaves())
+        bind_fields(leaf->fog_of_war, leaf->light, leaf->bb_leaf_room);
     }
     
     void create_corridors(int min_corridor_half_width = 1)
@@ -505,9 +503,7 @@ namespace dung
                   auto* corr = corridors.emplace_back(std::make_unique<Corridor>()).get();
                   corr->bb = { (r0 + r1)/2 - min_corridor_half_width, c0, 2*min_corridor_half_width + 1, c1 - c0 + 1 };
                   corr->orientation = Orientation::Horizontal;
-                  size_t surf_area = corr->bb.r_len * corr->bb.c_len;
-                  corr->fog_of_war.resize(surf_area, true);
-                  corr->light.resize(surf_area, false);
+                  bind_fields(corr->fog_of_war, corr->light, corr->bb);
                   room_corridor_map[key] = corr;
                   return true;
                 }
@@ -575,9 +571,7 @@ namespace dung
                   auto* corr = corridors.emplace_back(std::make_unique<Corridor>()).get();
                   corr->bb = { r0, (c0 + c1)/2 - min_corridor_half_width, r1 - r0 + 1, 2*min_corridor_half_width + 1 };
                   corr->orientation = Orientation::Vertical;
-                  size_t surf_area = corr->bb.r_len * corr->bb.c_len;
-                  corr->fog_of_war.resize(surf_area, true);
-                  corr->light.resize(surf_area, false);
+                  bind_fields(corr->fog_of_war, corr->light, corr->bb);
                   room_corridor_map[key] = corr;
                   return true;
                 }
@@ -601,8 +595,8 @@ namespace dung
       {
         auto* room_0 = cp.first.first;
         auto* room_1 = cp.first.second;
-        auto* door_0 = doors.emplace_back(std::make_unique<Door>()).get();
-        auto* door_1 = doors.emplace_back(std::make_unique<Door>()).get();
+        auto* door_0 = doors_raw.emplace_back(doors.emplace_back(std::make_unique<Door>()).get());
+        auto* door_1 = doors_raw.emplace_back(doors.emplace_back(std::make_unique<Door>()).get());
         
         if (allow_passageways)
         {
@@ -709,17 +703,13 @@ namespace dung
       }
     }
     
-    std::map<std::pair<BSPNode*, BSPNode*>, Corridor*, PtrPairLess<BSPNode>> get_room_corridor_map() const
+    const std::map<std::pair<BSPNode*, BSPNode*>, Corridor*, PtrPairLess<BSPNode>>& get_room_corridor_map() const
     {
       return room_corridor_map;
     }
     
-    std::vector<Door*> fetch_doors() const
+    const std::vector<Door*>& fetch_doors() const
     {
-      std::vector<Door*> doors_raw;
-      doors_raw.reserve(doors.size());
-      for (const auto& d : doors)
-        doors_raw.emplace_back(d.get());
       return doors_raw;
     }
     
@@ -758,12 +748,19 @@ namespace dung
       m_root.print_tree();
     }
     
+    // The fog of war and light planes are saved as they are, for the whole floor.
+    // fields_version 1 : One bool_vector per room and per corridor. Written before the planes.
+    // fields_version 2 : The words of the planes.
     void serialize(std::vector<std::string>& lines) const
     {
-      m_root.serialize(lines);
-      lines.emplace_back("corridors");
-      for (const auto& c : corridors)
-        c->serialize(lines);
+      const int fields_version = 2;
+      std::vector<uint32_t> fog_of_war;
+      std::vector<uint32_t> light;
+      m_fog_of_war.export_words(fog_of_war);
+      m_light.export_words(light);
+      sg::write_var(lines, SG_WRITE_VAR(fields_version));
+      sg::write_var(lines, SG_WRITE_VAR(fog_of_war));
+      sg::write_var(lines, SG_WRITE_VAR(light));
       lines.emplace_back("doors");
       for (const auto& d : doors)
         d->serialize(lines);
@@ -772,15 +769,57 @@ namespace dung
     std::vector<std::string>::iterator deserialize(std::vector<std::string>::iterator it_line_begin,
                                                    std::vector<std::string>::iterator it_line_end)
     {
-      // -1 offset is a hack for the ++it_line hack in BSPNode::deserialize().
-      it_line_begin = m_root.deserialize(it_line_begin, it_line_end) - 1;
-      for (auto it_line = it_line_begin + 1; it_line != it_line_end; ++it_line)
+      int fields_version = 1; // Not written by version 1.
+      
+      std::vector<uint32_t> fog_of_war_words;
+      std::vector<uint32_t> light_words;
+      
+      // Version 1 : The rooms in leaf order, then the corridors.
+      auto leaves = fetch_leaves();
+      const int num_fields_v1 = stlutils::sizeI(leaves) + stlutils::sizeI(corridors);
+      auto f_fields_v1 = [&](int idx) -> std::pair<BitPlaneView*, BitPlaneView*>
       {
-        if (*it_line == "corridors")
-          for (auto& c : corridors)
-            it_line = c->deserialize(it_line + 1, it_line_end);
-        if (*it_line == "doors")
+        if (idx < stlutils::sizeI(leaves))
+          return { &leaves[idx]->fog_of_war, &leaves[idx]->light };
+        auto& corr = corridors[idx - stlutils::sizeI(leaves)];
+        return { &corr->fog_of_war, &corr->light };
+      };
+      int fog_of_war_idx_v1 = 0;
+      int light_idx_v1 = 0;
+      bool_vector fog_of_war;
+      bool_vector light;
+      
+      for (auto it_line = it_line_begin; it_line != it_line_end; ++it_line)
+      {
+        if (sg::read_var(&it_line, SG_READ_VAR(fields_version))) {}
+        else if (fields_version >= 2 && sg::read_var(&it_line, "fog_of_war", &fog_of_war_words))
+        {
+          if (!m_fog_of_war.import_words(fog_of_war_words))
+            std::cerr << "ERROR in BSPTree::deserialize() : Size mismatch of the fog of war plane!\n";
+        }
+        else if (fields_version >= 2 && sg::read_var(&it_line, "light", &light_words))
+        {
+          if (!m_light.import_words(light_words))
+            std::cerr << "ERROR in BSPTree::deserialize() : Size mismatch of the light plane!\n";
+        }
+        else if (fields_version == 1 && sg::read_var(&it_line, SG_READ_VAR(fog_of_war)))
+        {
+          if (fog_of_war_idx_v1 < num_fields_v1)
+            if (!f_fields_v1(fog_of_war_idx_v1++).first->copy_from(fog_of_war))
+              std::cerr << "ERROR in BSPTree::deserialize() : Size mismatch of the fog of war of a room or a corridor!\n";
+        }
+        else if (fields_version == 1 && sg::read_var(&it_line, SG_READ_VAR(light)))
+        {
+          if (light_idx_v1 < num_fields_v1)
+            if (!f_fields_v1(light_idx_v1++).second->copy_from(light))
+              std::cerr << "ERROR in BSPTree::deserialize() : Size mismatch of the light of a room or a corridor!\n";
+        }
+        else if (*it_line == "doors")
         {
+          for (auto* leaf : leaves)
+            leaf->fog_of_war.refresh_summary();
+          for (auto& c : corridors)
+            c->fog_of_war.refresh_summary();
           for (auto& d : doors)
             it_line = d->deserialize(it_line + 1, it_line_end);
           return it_line;
@@ -0,0 +1,372 @@
+//
+//  BitPlane.h
+//  DungGine
+//
+//  Created by Rasmus Anthin on 2026-10-17.
+//
+
+#pragma once
+#include <Core/bool_vector.h>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+
+namespace dung
+{
+
+  // Row-major grid of bits packed into 64-bit words.
+  // Every row starts at a new word so that a horizontal span can be
+  //   filled or masked a whole word at a time.
+  class BitPlane
+  {
+    static constexpr int c_word_bits = 64;
+
+    int m_rows = 0;
+    int m_cols = 0;
+    int m_words_per_row = 0;
+    std::vector<uint64_t> m_words;
+    uint64_t m_generation = 0; // Bumped by every write that changes a word.
+
+    // Bits c_start .. c_end (inclusive) of the word, both in [0, 63].
+    static uint64_t calc_mask(int c_start, int c_end)
+    {
+      uint64_t hi = c_end == c_word_bits - 1 ? ~uint64_t { 0 } : (uint64_t { 1 } << (c_end + 1)) - 1;
+      uint64_t lo = (uint64_t { 1 } << c_start) - 1;
+      return hi & ~lo;
+    }
+
+    // Calls f(word_idx, mask) for each word that the span overlaps.
+    template<typename Lambda>
+    void for_each_span_word(int r, int c_start, int c_end, Lambda f) const
+    {
+      if (r < 0 || r >= m_rows)
+        return;
+      if (c_start < 0)
+        c_start = 0;
+      if (c_end >= m_cols)
+        c_end = m_cols - 1;
+      if (c_start > c_end)
+        return;
+      int row_offs = r * m_words_per_row;
+      int w_start = c_start / c_word_bits;
+      int w_end = c_end / c_word_bits;
+      for (int w = w_start; w <= w_end; ++w)
+      {
+        int b_start = w == w_start ? c_start % c_word_bits : 0;
+        int b_end = w == w_end ? c_end % c_word_bits : c_word_bits - 1;
+        f(row_offs + w, calc_mask(b_start, b_end));
+      }
+    }
+
+  public:
+    void reset(int rows, int cols, bool val = false)
+    {
+      m_rows = rows;
+      m_cols = cols;
+      m_words_per_row = (cols + c_word_bits - 1) / c_word_bits;
+      m_words.assign(static_cast<size_t>(rows) * m_words_per_row, val ? ~uint64_t { 0 } : 0);
+      m_generation++;
+    }
+
+    void clear()
+    {
+      m_rows = 0;
+      m_cols = 0;
+      m_words_per_row = 0;
+      m_words.clear();
+      m_generation++;
+    }
+
+    void fill(bool val)
+    {
+      const uint64_t word = val ? ~uint64_t { 0 } : 0;
+      for (auto& w : m_words)
+        if (w != word)
+        {
+          w = word;
+          m_generation++;
+        }
+    }
+
+    int num_rows() const { return m_rows; }
+    int num_cols() const { return m_cols; }
+    
+    // Lets caches of the contents of the plane tell whether they are stale.
+    uint64_t get_generation() const { return m_generation; }
+
+    bool get(int r, int c) const
+    {
+      if (r < 0 || c < 0 || r >= m_rows || c >= m_cols)
+        return false;
+      return (m_words[r * m_words_per_row + c / c_word_bits] >> (c % c_word_bits)) & 1;
+    }
+
+    void set(int r, int c, bool val)
+    {
+      if (r < 0 || c < 0 || r >= m_rows || c >= m_cols)
+        return;
+      auto& word = m_words[r * m_words_per_row + c / c_word_bits];
+      auto bit = uint64_t { 1 } << (c % c_word_bits);
+      if (((word & bit) != 0) == val)
+        return;
+      m_generation++;
+      if (val)
+        word |= bit;
+      else
+        word &= ~bit;
+    }
+
+    // Columns c_start .. c_end (inclusive) of row r. Clipped to the plane.
+    void set_span(int r, int c_start, int c_end, bool val)
+    {
+      for_each_span_word(r, c_start, c_end, [&](int w, uint64_t mask)
+      {
+        auto word = val ? m_words[w] | mask : m_words[w] & ~mask;
+        if (word != m_words[w])
+        {
+          m_words[w] = word;
+          m_generation++;
+        }
+      });
+    }
+
+    // this |= other, for columns c_start .. c_end (inclusive) of row r.
+    // Both planes must have the same size.
+    void or_span(const BitPlane& other, int r, int c_start, int c_end)
+    {
+      if (other.m_rows != m_rows || other.m_cols != m_cols)
+        return;
+      for_each_span_word(r, c_start, c_end, [&](int w, uint64_t mask)
+      {
+        auto word = m_words[w] | (other.m_words[w] & mask);
+        if (word != m_words[w])
+        {
+          m_words[w] = word;
+          m_generation++;
+        }
+      });
+    }
+    
+    // Columns c .. c + n - 1 (n in [1, 64]) of row r, with column c in bit 0.
+    // Unlike the spans above, the columns need not be aligned to the words.
+    // Columns outside of the plane read as zero.
+    uint64_t get_bits(int r, int c, int n) const
+    {
+      if (r < 0 || r >= m_rows || n <= 0)
+        return 0;
+      int c_lo = std::max(c, 0);
+      int c_hi = std::min(c + std::min(n, c_word_bits), m_cols); // Exclusive.
+      if (c_lo >= c_hi)
+        return 0;
+      const auto* row = &m_words[r * m_words_per_row];
+      int w = c_lo / c_word_bits;
+      int b = c_lo % c_word_bits;
+      uint64_t bits = row[w] >> b;
+      if (b > 0 && w + 1 < m_words_per_row)
+        bits |= row[w + 1] << (c_word_bits - b);
+      int len = c_hi - c_lo;
+      if (len < c_word_bits)
+        bits &= (uint64_t { 1 } << len) - 1;
+      return bits << (c_lo - c);
+    }
+    
+    // Columns c .. c + n - 1 (n in [1, 64]) of row r become (old & ~mask) | (bits & mask),
+    //   with column c in bit 0. Columns outside of the plane are left alone.
+    void write_bits(int r, int c, int n, uint64_t bits, uint64_t mask = ~uint64_t { 0 })
+    {
+      if (r < 0 || r >= m_rows || n <= 0)
+        return;
+      int c_lo = std::max(c, 0);
+      int c_hi = std::min(c + std::min(n, c_word_bits), m_cols); // Exclusive.
+      if (c_lo >= c_hi)
+        return;
+      bits >>= c_lo - c;
+      mask >>= c_lo - c;
+      int len = c_hi - c_lo;
+      if (len < c_word_bits)
+        mask &= (uint64_t { 1 } << len) - 1;
+      bits &= mask;
+      auto* row = &m_words[r * m_words_per_row];
+      int w = c_lo / c_word_bits;
+      int b = c_lo % c_word_bits;
+      auto f_write = [this](uint64_t& word, uint64_t new_word)
+      {
+        if (new_word != word)
+        {
+          word = new_word;
+          m_generation++;
+        }
+      };
+      f_write(row[w], (row[w] & ~(mask << b)) | (bits << b));
+      if (b > 0 && w + 1 < m_words_per_row)
+        f_write(row[w + 1], (row[w + 1] & ~(mask >> (c_word_bits - b))) | (bits >> (c_word_bits - b)));
+    }
+    
+    // For the save games, which store numbers as doubles, so the words are split in 32-bit halves.
+    void export_words(std::vector<uint32_t>& words) const
+    {
+      words.resize(m_words.size() * 2);
+      for (size_t w = 0; w < m_words.size(); ++w)
+      {
+        words[2*w] = static_cast<uint32_t>(m_words[w]);
+        words[2*w + 1] = static_cast<uint32_t>(m_words[w] >> 32);
+      }
+    }
+    
+    // Returns false, and leaves the plane as it is, if the words are of a plane of another size.
+    bool import_words(const std::vector<uint32_t>& words)
+    {
+      if (words.size() != m_words.size() * 2)
+        return false;
+      for (size_t w = 0; w < m_words.size(); ++w)
+        m_words[w] = words[2*w] | (static_cast<uint64_t>(words[2*w + 1]) << 32);
+      m_generation++;
+      return true;
+    }
+  };
+  
+  // A rectangle of a BitPlane, addressed relative to the top left corner of the rectangle.
+  // The rooms and corridors of a floor see their parts of the fog of war and light planes
+  //   of the floor through views, so whole rows of a field can be read and written a word at a time.
+  class BitPlaneView
+  {
+    static constexpr int c_word_bits = 64;
+    
+    BitPlane* m_plane = nullptr;
+    int m_r = 0;
+    int m_c = 0;
+    int m_r_len = 0;
+    int m_c_len = 0;
+    
+  public:
+    void bind(BitPlane* plane, int r, int c, int r_len, int c_len)
+    {
+      m_plane = plane;
+      m_r = r;
+      m_c = c;
+      m_r_len = r_len;
+      m_c_len = c_len;
+    }
+    
+    bool is_bound() const { return m_plane != nullptr; }
+    int num_rows() const { return m_r_len; }
+    int num_cols() const { return m_c_len; }
+    
+    bool in_bounds(int r, int c) const
+    {
+      return m_plane != nullptr && 0 <= r && r < m_r_len && 0 <= c && c < m_c_len;
+    }
+    
+    bool get(int r, int c) const
+    {
+      return in_bounds(r, c) && m_plane->get(m_r + r, m_c + c);
+    }
+    
+    void set(int r, int c, bool val)
+    {
+      if (in_bounds(r, c))
+        m_plane->set(m_r + r, m_c + c, val);
+    }
+    
+    // See BitPlane::get_bits(). Columns outside of the view read as zero.
+    uint64_t get_bits(int r, int c, int n) const
+    {
+      if (m_plane == nullptr || r < 0 || r >= m_r_len)
+        return 0;
+      int c_lo = std::max(c, 0);
+      int c_hi = std::min(c + std::min(n, c_word_bits), m_c_len);
+      if (c_lo >= c_hi)
+        return 0;
+      return m_plane->get_bits(m_r + r, m_c + c_lo, c_hi - c_lo) << (c_lo - c);
+    }
+    
+    // See BitPlane::write_bits(). Columns outside of the view are left alone.
+    void write_bits(int r, int c, int n, uint64_t bits, uint64_t mask = ~uint64_t { 0 })
+    {
+      if (m_plane == nullptr || r < 0 || r >= m_r_len)
+        return;
+      int c_lo = std::max(c, 0);
+      int c_hi = std::min(c + std::min(n, c_word_bits), m_c_len);
+      if (c_lo >= c_hi)
+        return;
+      m_plane->write_bits(m_r + r, m_c + c_lo, c_hi - c_lo, bits >> (c_lo - c), mask >> (c_lo - c));
+    }
+    
+    void fill(bool val)
+    {
+      if (m_plane == nullptr)
+        return;
+      for (int r = 0; r < m_r_len; ++r)
+        m_plane->set_span(m_r + r, m_c, m_c + m_c_len - 1, val);
+    }
+    
+    // Overwrites the view with a plane of the same size as the view.
+    void assign(const BitPlane& src)
+    {
+      for (int r = 0; r < m_r_len; ++r)
+        for (int c = 0; c < m_c_len; c += c_word_bits)
+          write_bits(r, c, c_word_bits, src.get_bits(r, c, c_word_bits));
+    }
+    
+    // True if every bit of the view is val.
+    bool all(bool val) const
+    {
+      if (m_plane == nullptr)
+        return false;
+      for (int r = 0; r < m_r_len; ++r)
+        for (int c = 0; c < m_c_len; c += c_word_bits)
+        {
+          int n = std::min(c_word_bits, m_c_len - c);
+          uint64_t ones = n == c_word_bits ? ~uint64_t { 0 } : (uint64_t { 1 } << n) - 1;
+          if (get_bits(r, c, n) != (val ? ones : 0))
+            return false;
+        }
+      return true;
+    }
+    
+    // Row-major, as of the save games from before the bit planes.
+    // Returns false, and leaves the view as it is, if src is not of the size of the view.
+    bool copy_from(const bool_vector& src)
+    {
+      if (m_plane == nullptr || src.size() != static_cast<size_t>(m_r_len) * m_c_len)
+        return false;
+      for (int r = 0; r < m_r_len; ++r)
+        for (int c = 0; c < m_c_len; ++c)
+          m_plane->set(m_r + r, m_c + c, src[static_cast<size_t>(r) * m_c_len + c]);
+      return true;
+    }
+    
+    // Row-major, for the drawing functions of Termin8or.
+    void copy_to(bool_vector& dst) const
+    {
+      dst.resize(static_cast<size_t>(m_r_len) * m_c_len);
+      for (int r = 0; r < m_r_len; ++r)
+        for (int c = 0; c < m_c_len; c += c_word_bits)
+        {
+          int n = std::min(c_word_bits, m_c_len - c);
+          uint64_t bits = get_bits(r, c, n);
+          size_t idx = static_cast<size_t>(r) * m_c_len + c;
+          for (int b = 0; b < n; ++b)
+            dst[idx + b] = (bits >> b) & 1;
+        }
+    }
+  };
+
+  // The fog of war of a room or a corridor, with a summary that lets the drawing skip
+  //   the rooms and corridors that are fully fogged without reading the field.
+  class FogOfWarView : public BitPlaneView
+  {
+    bool m_fully_fogged = true;
+    
+  public:
+    // Fog of war is only ever cleared, so this only needs to be called while is_fully_fogged().
+    void refresh_summary()
+    {
+      m_fully_fogged = all(true);
+    }
+    
+    bool is_fully_fogged() const { return m_fully_fogged; }
+  };
+
+}
@@ -7,10 +7,9 @@
 
 #pragma once
 #include "Orientation.h"
-#include "SaveGame.h"
+#include "BitPlane.h"
 #include <Core/Utils.h>
 #include <Termin8or/geom/Rectangle.h>
-#include <Core/bool_vector.h>
 
 
 namespace dung
@@ -35,8 +34,8 @@ namespace dung
     Orientation orientation = Orientation::Vertical;
     std::array<Door*, 2> doors;
     
-    bool_vector fog_of_war;
-    bool_vector light;
+    FogOfWarView fog_of_war; // Views into the planes of the BSPTree.
+    BitPlaneView light;
     
     bool is_inside_corridor(const RC& pos, BBLocation* location = nullptr) const
     {
@@ -82,40 +81,15 @@ namespace dung
     bool is_in_fog_of_war(const RC& world_pos)
     {
       auto local_pos = world_pos - bb.pos();
-      auto idx = local_pos.r * bb.c_len + local_pos.c;
-      if (math::in_range<int>(idx, 0, stlutils::sizeI(fog_of_war), Range::ClosedOpen))
-        return fog_of_war[idx];
-      return true;
+      if (!fog_of_war.in_bounds(local_pos.r, local_pos.c))
+        return true;
+      return fog_of_war.get(local_pos.r, local_pos.c);
     }
     
     bool is_in_light(const RC& world_pos)
     {
       auto local_pos = world_pos - bb.pos();
-      auto idx = local_pos.r * bb.c_len + local_pos.c;
-      if (math::in_range<int>(idx, 0, stlutils::sizeI(light), Range::ClosedOpen))
-        return light[idx];
-      return false;
-    }
-    
-    void serialize(std::vector<std::string>& lines) const
-    {
-      sg::write_var(lines, SG_WRITE_VAR(fog_of_war));
-      sg::write_var(lines, SG_WRITE_VAR(light));
-    }
-    
-    std::vector<std::string>::iterator deserialize(std::vector<std::string>::iterator it_line_begin,
-                                                   std::vector<std::string>::iterator it_line_end)
-    {
-      for (auto it_line = it_line_begin; it_line != it_line_end; ++it_line)
-      {
-        if (sg::read_var(&it_line, SG_READ_VAR(fog_of_war))) {}
-        else if (sg::read_var(&it_line, SG_READ_VAR(light)))
-        {
-          return it_line;
-        }
-      }
-      
-      return it_line_end;
+      return light.get(local_pos.r, local_pos.c);
     }
   };
 
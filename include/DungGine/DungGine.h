@@ -20,6 +20,14 @@
 #include "DungGineListener.h"
 #include "Inventory.h"
 #include "Keyboard.h"
+#include "EntityIndex.h"
+#include "LightStencils.h"
+#include "ShadowCasting.h"
+#include "LightMaps.h"
+#include "RenderSnapshot.h"
+#include "WorkerPool.h"
+#include "FlowField.h"
+#include "PathFinder.h"
 #include "SaveGame.h"
 #include <Termin8or/input/Keyboard.h>
 #include <Termin8or/ui/MessageHandler.h>
@@ -28,6 +36,9 @@
 #include <Core/Utils.h>
 #include <Core/System.h>
 #include <Core/Timer.h>
+#include <array>
+#include <atomic>
+#include <future>
 
 using namespace utils::literals;
 using namespace t8::literals;
@@ -48,6 +59,7 @@ namespace dung
     Longitude m_longitude = Longitude::F;
     Season m_season = Season::Spring;
     SolarMotionPatterns m_solar_motion;
+    SolarDirectionTable m_solar_dirs; // Used when m_use_per_room_lat_long_for_sun_dir is set.
     float m_sun_minutes_per_day = 20.f;
     float m_sun_day_t_offs = 0.f;
     float m_sun_minutes_per_year = 120.f;
@@ -76,6 +88,115 @@ namespace dung
     std::vector<Potion> all_potions;
     std::vector<std::unique_ptr<Armour>> all_armour;
     
+    // Items lying in the world, NPCs and blood splats per floor and per room / corridor.
+    EntityIndex m_entity_index;
+    // Where the light field was last applied, so that items can be unlit after the PC has left.
+    int m_light_floor = -1;
+    BSPNode* m_light_room = nullptr;
+    Corridor* m_light_corridor = nullptr;
+    
+    // Everything that the fog of war and light fields and the visible flags depend on.
+    struct VisibilityInputs
+    {
+      RC pc_pos;
+      int pc_floor = -1;
+      BSPNode* pc_room = nullptr;
+      Corridor* pc_corridor = nullptr;
+      float pc_los_r = 0.f;
+      float pc_los_c = 0.f;
+      const Lamp* lamp = nullptr;
+      int lamp_radius_q = 0;
+      int fow_radius_q = 0;
+      int num_door_state_changes = 0;
+      SolarDirection sun_dir = SolarDirection::E;
+      Season season = Season::Spring;
+      int solar_phase_idx = 0;
+      int entity_index_generation = 0;
+      int static_light_generation = 0;
+      
+      bool operator==(const VisibilityInputs&) const = default;
+    };
+    std::optional<VisibilityInputs> m_visibility_inputs; // nullopt : fields need to be recomputed.
+    bool m_refresh_visibilities = true;
+    
+    // Everything that draw() depends on, except for the things that animate by themselves.
+    struct NPCFrameInputs
+    {
+      RC pos;
+      bool visible = false;
+      bool is_hostile = false;
+      int health = 0;
+      
+      bool operator==(const NPCFrameInputs&) const = default;
+    };
+    struct FrameInputs
+    {
+      RC scr_world_pos;
+      std::optional<VisibilityInputs> visibility_inputs;
+      int num_handled_keys = 0;
+      int pc_health = 0;
+      int pc_strength = 0;
+      bool pc_show_inventory = false;
+      unsigned short texture_anim_ctr = 0;
+      
+      bool operator==(const FrameInputs&) const = default;
+    };
+    std::optional<FrameInputs> m_frame_inputs; // nullopt : next frame must be drawn.
+    std::vector<NPCFrameInputs> m_npc_frame_inputs; // NPCs on the floor of the PC. Updated in place.
+    int m_frame_generation = 0;
+    bool m_frame_dirty = true;
+    static constexpr float c_message_linger_s = 5.f; // Messages expire by themselves.
+    
+    LightStencilCache m_light_stencils;
+    FovMask m_fov_room;
+    FovMask m_fov_corridor;
+    
+    BitPlane m_drawn_cells; // Screen textels already written to by draw().
+    
+    // Triple buffered. update() fills in the back snapshot and then swaps it with the ready one.
+    // draw() swaps the ready one with the front one if it is fresh, and only reads the front one.
+    // So no snapshot is written to while it is drawn, and draw() always gets the latest complete one.
+    static constexpr int c_render_snapshot_fresh = 4; // Flag of m_ready_render_snapshot.
+    std::array<RenderSnapshot, 3> m_render_snapshots;
+    int m_back_render_snapshot = 0; // Only touched by update().
+    int m_front_render_snapshot = 2; // Only touched by draw().
+    std::atomic<int> m_ready_render_snapshot = 1;
+    
+    // Lamps lying in the world light up the room or the corridor they are in.
+    bool m_placed_lamps_emit_light = false;
+    StaticLightMaps m_static_light_maps;
+    int m_static_light_lamp_generation = -1; // Lamp generation of the entity index that the lightmaps were baked for.
+    
+    // Simulation level of detail of the NPCs, see calc_npc_sim_lod().
+    enum class NPCSimLOD { Full, Coarse, Suspended };
+    static constexpr int c_npc_coarse_tick_interval = 4; // In frames.
+    bool m_use_npc_sim_lod = false;
+    int m_npc_sim_lod_floor = -1; // Floor of the PC when the NPCs were last ticked.
+    
+    struct NPCTick
+    {
+      bool do_tick = false;
+      bool do_los_terrainos = false;
+      float dt = 0.f;
+      bool moves = false; // Set by NPC::update_pre().
+    };
+    std::vector<NPCTick> m_npc_ticks; // Per NPC, for the current frame.
+    std::vector<int> m_npc_moving_idcs; // The NPCs that move this frame, one per slot in m_npc_kinematics.
+    NPCKinematics m_npc_kinematics;
+    WorkerPool m_npc_workers;
+    unsigned int m_npc_rnd_seed = 0; // Game seed that the RandomStream of each NPC is derived from.
+    
+    // Distances to the PC, shared by all the pursuing NPCs. One per floor, baked on first use.
+    // Only searched again when the PC steps onto another cell or a door is opened or closed.
+    std::vector<FlowField> m_pursuit_fields;
+    static constexpr int c_pursuit_field_max_dist = 2*static_cast<int>(NPC::c_dist_patroll);
+    int m_pursuit_field_floor = -1;
+    int m_pursuit_field_door_state_changes = -1;
+    
+    // Routes across rooms, corridors and floors. Built on first use and rebuilt when the staircases change.
+    PathFinder m_path_finder;
+    int m_path_finder_staircase_generation = -1;
+    
     std::unique_ptr<MessageHandler> message_handler;
     bool use_fog_of_war = false;
     
@@ -84,6 +205,7 @@ namespace dung
     enum class FightDir { NW, W, SW, S, SE, E, NE, N, NUM_ITEMS };
     const std::vector<int> fight_r_offs = { 1, 0, -1, -1, -1, 0, 1, 1 };
     const std::vector<int> fight_c_offs = { 1, 1, 1, 0, -1, -1, -1, 0 };
+    std::vector<FightRenderState> m_fight_marks; // Filled in by update_fight_effects().
     
     struct Projectile
     {
@@ -110,6 +232,9 @@ namespace dung
     bool trigger_game_save = false;
     bool trigger_game_load = false;
     bool trigger_screenshot = false;
+    // The screenshot file is encoded and written on a worker thread, see poll_screenshot_export().
+    std::future<bool> m_screenshot_export;
+    std::string m_screenshot_filepath;
     bool use_save_game_git_hash_check = false;
     std::string path_to_dunggine_repo; // Path to where the DungGine repo is checked out.
     
@@ -122,6 +247,8 @@ namespace dung
       
       float t_season_period = std::fmod(m_sun_year_t_offs + (real_time_s / 60.f) / m_sun_minutes_per_year, 1.f);
       m_season = static_cast<Season>(math::roundI(7*t_season_period));
+      
+      m_solar_dirs.update(m_solar_motion, m_season, m_t_solar_period);
     }
     
     void update_inventory()
@@ -295,66 +422,84 @@ namespace dung
       m_inventory->apply_deserialization_changes();
     }
     
-    template<typename Lambda>
-    void clear_field(Lambda get_field_ptr, bool clear_val)
+    void rebuild_entity_index()
     {
-      for (auto& key : all_keys)
-        *get_field_ptr(&key) = clear_val;
-        
-      for (auto& lamp : all_lamps)
-        *get_field_ptr(&lamp) = clear_val;
+      m_entity_index.reset(m_environment->num_floors());
       
-      for (auto& weapon : all_weapons)
-        *get_field_ptr(weapon.get()) = clear_val;
-        
-      for (auto& potion : all_potions)
-        *get_field_ptr(&potion) = clear_val;
+      for (int key_idx = 0; key_idx < stlutils::sizeI(all_keys); ++key_idx)
+        if (!all_keys[key_idx].picked_up)
+          m_entity_index.insert(EntityType::Key, key_idx, all_keys[key_idx]);
       
-      for (auto& armour : all_armour)
-        *get_field_ptr(armour.get()) = clear_val;
-        
-      for (auto& bs : m_player.blood_splats)
-        *get_field_ptr(&bs) = clear_val;
-        
-      for (auto& npc : all_npcs)
-        for (auto& bs : npc.blood_splats)
-          *get_field_ptr(&bs) = clear_val;
-        
-      // #NOTE: fog_of_war and light vars set by NPC class itself.
-      //for (auto& npc : all_npcs)
-      //  *get_field_ptr(&npc) = clear_val;
+      for (int lamp_idx = 0; lamp_idx < stlutils::sizeI(all_lamps); ++lamp_idx)
+        if (!all_lamps[lamp_idx].picked_up)
+          m_entity_index.insert(EntityType::Lamp, lamp_idx, all_lamps[lamp_idx]);
       
-      //ttl::Rectangle bb;
-      bool_vector* field = nullptr;
+      for (int wpn_idx = 0; wpn_idx < stlutils::sizeI(all_weapons); ++wpn_idx)
+        if (!all_weapons[wpn_idx]->picked_up)
+          m_entity_index.insert(EntityType::Weapon, wpn_idx, *all_weapons[wpn_idx]);
       
-      if (m_player.curr_corridor != nullptr)
+      for (int pot_idx = 0; pot_idx < stlutils::sizeI(all_potions); ++pot_idx)
+        if (!all_potions[pot_idx].picked_up)
+          m_entity_index.insert(EntityType::Potion, pot_idx, all_potions[pot_idx]);
+      
+      for (int a_idx = 0; a_idx < stlutils::sizeI(all_armour); ++a_idx)
+        if (!all_armour[a_idx]->picked_up)
+          m_entity_index.insert(EntityType::Armour, a_idx, *all_armour[a_idx]);
+      
+      for (int npc_idx = 0; npc_idx < stlutils::sizeI(all_npcs); ++npc_idx)
+        m_entity_index.insert(EntityType::NPC, npc_idx, all_npcs[npc_idx]);
+      
+      for (int bs_idx = 0; bs_idx < stlutils::sizeI(m_player.blood_splats); ++bs_idx)
+        m_entity_index.insert_blood_splat(-1, bs_idx, m_player.blood_splats[bs_idx]);
+      
+      for (int npc_idx = 0; npc_idx < stlutils::sizeI(all_npcs); ++npc_idx)
       {
-        //bb = m_player.curr_corridor->bb;
-        field = get_field_ptr(m_player.curr_corridor);
-        
-        auto* door_0 = m_player.curr_corridor->doors[0];
-        auto* door_1 = m_player.curr_corridor->doors[1];
-        //stlutils::memset(*field, clear_val);
-        stlutils::fill(*field, clear_val);
-        
-        *get_field_ptr(door_0) = clear_val;
-        *get_field_ptr(door_1) = clear_val;
+        const auto& npc = all_npcs[npc_idx];
+        for (int bs_idx = 0; bs_idx < stlutils::sizeI(npc.blood_splats); ++bs_idx)
+          m_entity_index.insert_blood_splat(npc_idx, bs_idx, npc.blood_splats[bs_idx]);
       }
-      if (m_player.curr_room != nullptr)
+    }
+    
+    template<typename Lambda>
+    void for_each_item(const EntityBucket& bucket, Lambda f)
+    {
+      for (int key_idx : bucket.key_idcs)
+        f(all_keys[key_idx]);
+      
+      for (int lamp_idx : bucket.lamp_idcs)
+        f(all_lamps[lamp_idx]);
+      
+      for (int wpn_idx : bucket.weapon_idcs)
+        f(*all_weapons[wpn_idx]);
+      
+      for (int pot_idx : bucket.potion_idcs)
+        f(all_potions[pot_idx]);
+      
+      for (int a_idx : bucket.armour_idcs)
+        f(*all_armour[a_idx]);
+    }
+    
+    template<typename Lambda>
+    void for_each_blood_splat(const EntityBucket& bucket, Lambda f)
+    {
+      for (const auto& bs_ref : bucket.blood_splat_refs)
       {
-        //bb = m_player.curr_room->bb_leaf_room;
-        field = get_field_ptr(m_player.curr_room);
-        //stlutils::memset(*field, clear_val);
-        stlutils::fill(*field, clear_val);
-        
-        for (auto* door : m_player.curr_room->doors)
-          *get_field_ptr(door) = clear_val;
-          
-        auto* staircase = m_player.curr_room->staircase;
-        if (staircase != nullptr)
-          *get_field_ptr(staircase) = clear_val;
+        auto& blood_splats = bs_ref.owner_idx == -1 ? m_player.blood_splats : all_npcs[bs_ref.owner_idx].blood_splats;
+        f(blood_splats[bs_ref.splat_idx]);
       }
-
+    }
+    
+    // Items and blood splats inside the given room or corridor.
+    template<typename Lambda>
+    void for_each_item_and_blood_splat_in(int floor, const BSPNode* room, const Corridor* corridor, Lambda f)
+    {
+      const auto& room_bucket = m_entity_index.fetch_room_bucket(floor, room);
+      for_each_item(room_bucket, f);
+      for_each_blood_splat(room_bucket, f);
+      
+      const auto& corr_bucket = m_entity_index.fetch_corridor_bucket(floor, corridor);
+      for_each_item(corr_bucket, f);
+      for_each_blood_splat(corr_bucket, f);
     }
     
     template<typename Lambda>
@@ -363,66 +508,87 @@ namespace dung
     {
       const auto c_fow_dist = radius; //2.3f;
       
+      // The arc limits only depend on the LOS, so they are computed once and not per item.
+      float lo_angle_rad = 0.f;
+      float hi_angle_rad = 0.f;
+      if (src_type == Lamp::LightType::Directional)
+      {
+        // #FIXME: Move parts into math functions for better reuse.
+        // Rotating dir vector CW and CCW using a rotation matrix.
+        auto a = math::deg2rad(angle_deg*0.5f);
+        auto dir_r = m_player.los_r;
+        auto dir_c = m_player.los_c;
+        auto Clo = std::cos(-a);
+        auto Slo = std::sin(-a);
+        auto Chi = std::cos(+a);
+        auto Shi = std::sin(+a);
+        math::normalize(dir_r, dir_c);
+        float dir_lo_r = (dir_r*Clo - dir_c*Slo);
+        float dir_lo_c = dir_r*Slo + dir_c*Clo;
+        float dir_hi_r = (dir_r*Chi - dir_c*Shi);
+        float dir_hi_c = dir_r*Shi + dir_c*Chi;
+        
+        lo_angle_rad = math::atan2n(-dir_lo_r, dir_lo_c);
+        hi_angle_rad = math::atan2n(-dir_hi_r, dir_hi_c);
+        if (lo_angle_rad > hi_angle_rad)
+          hi_angle_rad += math::c_2pi;
+      }
+      
+      auto* pc_corr = m_player.curr_corridor != nullptr && m_player.curr_corridor->is_inside_corridor(curr_pos) ?
+        m_player.curr_corridor : nullptr;
+      auto* pc_room = m_player.curr_room != nullptr && m_player.curr_room->is_inside_room(curr_pos) ?
+        m_player.curr_room : nullptr;
+      
+      const auto& stencil = m_light_stencils.fetch_stencil(radius, angle_deg, src_type,
+                                                           m_player.los_r, m_player.los_c);
+      
+      // Walls, closed doors and terrain that can't be walked on (columns, trees, etc.) cast shadows.
+      m_fov_corridor.clear();
+      if (pc_corr != nullptr)
+      {
+        m_fov_corridor.reset(pc_corr->bb);
+        m_fov_corridor.cast(curr_pos, stencil.max_dist,
+                            [pc_corr](const RC& p) { return !pc_corr->is_inside_corridor(p); });
+      }
+      m_fov_room.clear();
+      if (pc_room != nullptr)
+      {
+        m_fov_room.reset(pc_room->bb_leaf_room);
+        m_fov_room.cast(curr_pos, stencil.max_dist, [&](const RC& p)
+        {
+          return !pc_room->bb_leaf_room.is_inside_offs(p, -1) ||
+            !m_environment->allow_move_to(m_player.curr_floor, p.r, p.c);
+        });
+      }
+      auto f_in_fov = [this](const RC& p)
+      {
+        if (m_fov_room.is_inside(p))
+          return m_fov_room.is_visible(p);
+        if (m_fov_corridor.is_inside(p))
+          return m_fov_corridor.is_visible(p);
+        return true;
+      };
+      
       auto f_set_item_field = [&](auto& obj)
       {
-        if (m_player.curr_room == obj.curr_room || m_player.curr_corridor == obj.curr_corridor)
-          if (distance(obj.pos, curr_pos) <= radius)
+        if (distance(obj.pos, curr_pos) <= radius && f_in_fov(obj.pos))
+        {
+          if (src_type == Lamp::LightType::Directional)
           {
-            if (src_type == Lamp::LightType::Directional)
-            {
-              // #FIXME: Move parts into math functions for better reuse.
-              // Rotating dir vector CW and CCW using a rotation matrix.
-              auto a = math::deg2rad(angle_deg*0.5f);
-              auto dir_r = m_player.los_r;
-              auto dir_c = m_player.los_c;
-              auto Clo = std::cos(-a);
-              auto Slo = std::sin(-a);
-              auto Chi = std::cos(+a);
-              auto Shi = std::sin(+a);
-              math::normalize(dir_r, dir_c);
-              float dir_lo_r = (dir_r*Clo - dir_c*Slo);
-              float dir_lo_c = dir_r*Slo + dir_c*Clo;
-              float dir_hi_r = (dir_r*Chi - dir_c*Shi);
-              float dir_hi_c = dir_r*Shi + dir_c*Chi;
-    
-              float lo_angle_rad = math::atan2n(-dir_lo_r, dir_lo_c);
-              float hi_angle_rad = math::atan2n(-dir_hi_r, dir_hi_c);
-              if (lo_angle_rad > hi_angle_rad)
-                hi_angle_rad += math::c_2pi;
-                
-              float curr_angle_rad = math::atan2n<float>(-static_cast<float>(obj.pos.r - curr_pos.r),
-                                                          static_cast<float>(obj.pos.c - curr_pos.c));
-              if (curr_angle_rad < lo_angle_rad)
-                curr_angle_rad += math::c_2pi;
-              if (math::in_range<float>(curr_angle_rad, lo_angle_rad, hi_angle_rad, Range::Closed))
-                *get_field_ptr(&obj) = set_val;
-            }
-            else
+            float curr_angle_rad = math::atan2n<float>(-static_cast<float>(obj.pos.r - curr_pos.r),
+                                                        static_cast<float>(obj.pos.c - curr_pos.c));
+            if (curr_angle_rad < lo_angle_rad)
+              curr_angle_rad += math::c_2pi;
+            if (math::in_range<float>(curr_angle_rad, lo_angle_rad, hi_angle_rad, Range::Closed))
               *get_field_ptr(&obj) = set_val;
           }
+          else
+            *get_field_ptr(&obj) = set_val;
+        }
       };
       
-      for (auto& key : all_keys)
-        f_set_item_field(key);
-          
-      for (auto& lamp : all_lamps)
-        f_set_item_field(lamp);
-          
-      for (auto& weapon : all_weapons)
-        f_set_item_field(*weapon);
-          
-      for (auto& potion : all_potions)
-        f_set_item_field(potion);
-          
-      for (auto& armour : all_armour)
-        f_set_item_field(*armour);
-        
-      for (auto& bs : m_player.blood_splats)
-        f_set_item_field(bs);
-        
-      for (auto& npc : all_npcs)
-        for (auto& bs : npc.blood_splats)
-          f_set_item_field(bs);
+      for_each_item_and_blood_splat_in(m_player.curr_floor, m_player.curr_room, m_player.curr_corridor,
+                                       f_set_item_field);
       
       // #NOTE: fog_of_war and light vars set by NPC class itself.
       //for (auto& npc : all_npcs)
@@ -432,7 +598,8 @@ namespace dung
       t8::Rectangle bb;
       RC local_pos;
       RC size;
-      bool_vector* field = nullptr;
+      BitPlaneView* field = nullptr;
+      const FovMask* fov = nullptr;
       
       auto set_field = [&](const RC& p)
       {
@@ -440,17 +607,25 @@ namespace dung
           return;
         if (p.r < 0 || p.c < 0 || p.r >= bb.r_len || p.c >= bb.c_len)
           return;
-        // ex:
-        // +---+ 01234
-        // |   | 56789
-        // +---+ ABCDE
-        // r_len = 3, c_len = 5
-        // FOW size = 3*5
-        // idx = 0 .. 14
-        // r = 2, c = 4 => idx = r * c_len + c = 2*5 + 4 = 14.
-        int idx = p.r * size.c + p.c;
-        if (0 <= idx && idx < static_cast<int>(field->size()))
-          (*field)[idx] = set_val;
+        field->set(p.r, p.c, set_val);
+      };
+      
+      auto set_field_span = [&](const StencilSpan& span)
+      {
+        if (field == nullptr)
+          return;
+        int r = local_pos.r + span.r_offs;
+        if (r < 0 || r >= bb.r_len)
+          return;
+        int c_start = std::max(0, local_pos.c + span.c_offs_start);
+        int c_end = std::min(bb.c_len - 1, local_pos.c + span.c_offs_end);
+        // Up to a word of the span at a time, masked by the textels that are in view.
+        const uint64_t bits = set_val ? ~uint64_t { 0 } : 0;
+        for (int c = c_start; c <= c_end; c += 64)
+        {
+          int n = std::min(64, c_end - c + 1);
+          field->write_bits(r, c, n, bits, fov->get_plane().get_bits(r, c, n));
+        }
       };
       
       auto update_rect_field = [&]() // #FIXME: FHXFTW
@@ -458,20 +633,8 @@ namespace dung
         local_pos = curr_pos - bb.pos();
         size = bb.size();
         
-        std::vector<RC> positions;
-        switch (src_type)
-        {
-          case Lamp::LightType::Isotropic:
-            positions = t8x::filled_circle_positions(local_pos, radius, globals::px_aspect);
-            break;
-          case Lamp::LightType::Directional:
-            positions = t8x::filled_arc_positions(local_pos, radius, math::deg2rad(angle_deg), m_player.los_r, m_player.los_c, globals::px_aspect);
-            break;
-          case Lamp::LightType::NUM_ITEMS:
-            break;
-        }
-        for (const auto& pos : positions)
-          set_field(pos);
+        for (const auto& span : stencil.spans)
+          set_field_span(span);
         
         int r_room = -1;
         int c_room = -1;
@@ -488,57 +651,474 @@ namespace dung
           set_field({ r_room, c_room });
       };
       
-      if (m_player.curr_corridor != nullptr && m_player.curr_corridor->is_inside_corridor(curr_pos))
+      if (pc_corr != nullptr)
       {
-        bb = m_player.curr_corridor->bb;
-        field = get_field_ptr(m_player.curr_corridor);
+        bb = pc_corr->bb;
+        field = get_field_ptr(pc_corr);
+        fov = &m_fov_corridor;
         
-        auto* door_0 = m_player.curr_corridor->doors[0];
-        auto* door_1 = m_player.curr_corridor->doors[1];
+        auto* door_0 = pc_corr->doors[0];
+        auto* door_1 = pc_corr->doors[1];
         update_rect_field();
         
-        if (distance(door_0->pos, curr_pos) <= c_fow_dist)
+        if (distance(door_0->pos, curr_pos) <= c_fow_dist && f_in_fov(door_0->pos))
           *get_field_ptr(door_0) = set_val;
-        if (distance(door_1->pos, curr_pos) <= c_fow_dist)
+        if (distance(door_1->pos, curr_pos) <= c_fow_dist && f_in_fov(door_1->pos))
           *get_field_ptr(door_1) = set_val;
       }
-      if (m_player.curr_room != nullptr && m_player.curr_room->is_inside_room(curr_pos))
+      if (pc_room != nullptr)
       {
-        bb = m_player.curr_room->bb_leaf_room;
-        field = get_field_ptr(m_player.curr_room);
+        bb = pc_room->bb_leaf_room;
+        field = get_field_ptr(pc_room);
+        fov = &m_fov_room;
         update_rect_field();
         
-        for (auto* door : m_player.curr_room->doors)
-          if (distance(door->pos, curr_pos) <= c_fow_dist)
+        for (auto* door : pc_room->doors)
+          if (distance(door->pos, curr_pos) <= c_fow_dist && f_in_fov(door->pos))
             *get_field_ptr(door) = set_val;
             
-        auto* staircase = m_player.curr_room->staircase;
+        auto* staircase = pc_room->staircase;
         if (staircase != nullptr)
-          if (distance(staircase->pos, curr_pos) <= c_fow_dist)
+          if (distance(staircase->pos, curr_pos) <= c_fow_dist && f_in_fov(staircase->pos))
             *get_field_ptr(staircase) = set_val;
       }
     }
     
+    VisibilityInputs calc_visibility_inputs(float fow_radius, const Lamp* lamp) const
+    {
+      VisibilityInputs inputs;
+      inputs.pc_pos = m_player.pos;
+      inputs.pc_floor = m_player.curr_floor;
+      inputs.pc_room = m_player.curr_room;
+      inputs.pc_corridor = m_player.curr_corridor;
+      inputs.pc_los_r = m_player.los_r;
+      inputs.pc_los_c = m_player.los_c;
+      // Lamps burn down a little every frame, so only react to changes of a tenth of a textel.
+      inputs.lamp = lamp;
+      if (lamp != nullptr)
+        inputs.lamp_radius_q = math::roundI(10.f*lamp->radius);
+      inputs.fow_radius_q = math::roundI(10.f*fow_radius);
+      inputs.num_door_state_changes = m_keyboard->get_num_door_state_changes();
+      inputs.sun_dir = m_sun_dir;
+      inputs.season = m_season;
+      inputs.solar_phase_idx = SolarMotionPatterns::calc_phase_idx(m_t_solar_period);
+      inputs.entity_index_generation = m_entity_index.get_generation();
+      inputs.static_light_generation = m_static_light_maps.get_generation();
+      return inputs;
+    }
+    
+    // Overwrites the light of the room and corridor with the light of the lamps lying around.
+    void apply_static_light(int floor, BSPNode* room, Corridor* corridor)
+    {
+      for_each_item_and_blood_splat_in(floor, room, corridor,
+        [&](auto& obj) { obj.light = m_static_light_maps.is_lit(floor, room, corridor, obj.pos); });
+      
+      auto f_apply_door = [&](Door* door)
+      {
+        if (door != nullptr)
+          door->light = m_static_light_maps.is_lit(floor, door->room, door->corridor, door->pos);
+      };
+      
+      if (corridor != nullptr)
+      {
+        m_static_light_maps.copy_to(floor, corridor, corridor->light);
+        for (auto* door : corridor->doors)
+          f_apply_door(door);
+      }
+      if (room != nullptr)
+      {
+        m_static_light_maps.copy_to(floor, room, room->light);
+        for (auto* door : room->doors)
+          f_apply_door(door);
+        
+        auto* staircase = room->staircase;
+        if (staircase != nullptr)
+          staircase->light = m_static_light_maps.is_lit(floor, room, nullptr, staircase->pos);
+      }
+    }
+    
+    // Rebakes the lightmaps of the rooms and corridors whose lamps have changed.
+    void update_static_light()
+    {
+      if (!m_placed_lamps_emit_light)
+        return;
+      auto lamp_generation = m_entity_index.get_generation(EntityType::Lamp);
+      if (lamp_generation == m_static_light_lamp_generation)
+        return;
+      m_static_light_lamp_generation = lamp_generation;
+      
+      auto f_calc_sources = [this](const EntityBucket& bucket)
+      {
+        std::vector<StaticLightSource> sources;
+        for (int lamp_idx : bucket.lamp_idcs)
+        {
+          const auto& lamp = all_lamps[lamp_idx];
+          // Burnt out lamps have a radius of zero.
+          if (lamp.exists && lamp.radius > 0.f)
+            sources.push_back({ lamp.pos, math::roundI(10.f*lamp.radius) });
+        }
+        return sources;
+      };
+      
+      const auto* dungeon = m_environment->get_dungeon();
+      for (int f_idx = 0; f_idx < m_environment->num_floors(); ++f_idx)
+      {
+        auto* bsp_tree = dungeon->get_tree(f_idx);
+        for (auto* room : bsp_tree->fetch_leaves())
+        {
+          auto sources = f_calc_sources(m_entity_index.fetch_room_bucket(f_idx, room));
+          if (m_static_light_maps.update_room(f_idx, room, std::move(sources), m_light_stencils,
+                                              [&](const RC& p)
+                                              {
+                                                return !room->bb_leaf_room.is_inside_offs(p, -1) ||
+                                                  !m_environment->allow_move_to(f_idx, p.r, p.c);
+                                              }))
+            apply_static_light(f_idx, room, nullptr);
+        }
+        for (const auto& [room_pair, corr] : bsp_tree->get_room_corridor_map())
+        {
+          auto sources = f_calc_sources(m_entity_index.fetch_corridor_bucket(f_idx, corr));
+          if (m_static_light_maps.update_corridor(f_idx, corr, std::move(sources), m_light_stencils,
+                                                  [corr](const RC& p) { return !corr->is_inside_corridor(p); }))
+            apply_static_light(f_idx, nullptr, corr);
+        }
+      }
+    }
+    
+    void poll_screenshot_export(double real_time_s)
+    {
+      if (!m_screenshot_export.valid() ||
+          m_screenshot_export.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return;
+      bool success = m_screenshot_export.get();
+      if (success)
+      {
+        message_handler->add_message_multi_line(static_cast<float>(real_time_s),
+                                                { t8::GlyphString::from_ascii("Successfully saved screenshot:"),
+                                                  t8::GlyphString::from_ascii("\"" + m_screenshot_filepath + "\"!") },
+                                                t8x::MessageHandlerLevel::Guide,
+                                                3.f);
+      }
+      else
+      {
+        message_handler->add_message_multi_line(static_cast<float>(real_time_s),
+                                                { t8::GlyphString::from_ascii("ERROR : Unable to save screenshot to file:"),
+                                                  t8::GlyphString::from_ascii("\"" + m_screenshot_filepath + "\"!") },
+                                                t8x::MessageHandlerLevel::Fatal,
+                                                3.f);
+      }
+      broadcast([&](auto* l) { l->on_screenshot_saved(m_screenshot_filepath, success); });
+    }
+    
+    void publish_render_snapshot(float sim_time_s)
+    {
+      auto& snapshot = m_render_snapshots[m_back_render_snapshot];
+      snapshot.clear();
+      const int curr_floor = m_player.curr_floor;
+      snapshot.screen_helper = *m_screen_helper;
+      snapshot.curr_floor = curr_floor;
+      
+      snapshot.use_fog_of_war = use_fog_of_war;
+      snapshot.sun_dir = m_sun_dir;
+      snapshot.solar_dirs = m_solar_dirs;
+      snapshot.use_per_room_lat_long_for_sun_dir = m_use_per_room_lat_long_for_sun_dir;
+      snapshot.texture_anim_ctr = m_environment->get_texture_anim_ctr();
+      m_environment->fetch_fully_fogged(curr_floor, snapshot.room_fully_fogged, snapshot.corridor_fully_fogged);
+      if (const auto* bsp_tree = m_environment->get_dungeon()->get_tree(curr_floor); bsp_tree != nullptr)
+      {
+        snapshot.fog_of_war = bsp_tree->get_fog_of_war_plane();
+        snapshot.light = bsp_tree->get_light_plane();
+        snapshot.fields_generation = bsp_tree->get_fields_generation();
+      }
+      else
+      {
+        snapshot.fog_of_war.clear();
+        snapshot.light.clear();
+        snapshot.fields_generation = 0;
+      }
+      
+      auto& pc = snapshot.pc;
+      pc.pos = m_player.pos;
+      pc.glyph = m_player.glyph;
+      pc.style = m_player.style;
+      pc.is_spawned = m_player.is_spawned;
+      pc.on_terrain = m_player.on_terrain;
+      pc.is_moving = m_player.is_moving;
+      pc.los_r = m_player.los_r;
+      pc.los_c = m_player.los_c;
+      snapshot.pc_has_fire_smoke = m_player.has_fire_smoke(sim_time_s);
+      if (snapshot.pc_has_fire_smoke)
+        snapshot.pc_fire_smoke = m_player.fire_smoke_engine;
+      
+      const auto& floor_bucket = m_entity_index.fetch_floor_bucket(curr_floor);
+      for (int npc_idx : floor_bucket.npc_idcs)
+      {
+        const auto& npc = all_npcs[npc_idx];
+        auto& npc_rs = snapshot.npcs.emplace_back();
+        npc_rs.pos = npc.pos;
+        npc_rs.glyph = npc.glyph;
+        npc_rs.style = npc.style;
+        npc_rs.visible = npc.visible && npc.curr_floor == curr_floor;
+        npc_rs.on_terrain = npc.on_terrain;
+        npc_rs.health = npc.health;
+        npc_rs.can_swim = npc.can_swim;
+        npc_rs.can_fly = npc.can_fly;
+        npc_rs.death_time_s = npc.death_time_s;
+        npc_rs.is_moving = npc.is_moving;
+        npc_rs.los_r = npc.los_r;
+        npc_rs.los_c = npc.los_c;
+        npc_rs.debug = npc.debug;
+        if (npc.debug)
+        {
+          npc_rs.vel_r = npc.vel_r;
+          npc_rs.vel_c = npc.vel_c;
+          if (npc.curr_room != nullptr)
+            npc_rs.room_center = npc.curr_room->bb_leaf_room.center();
+          if (npc.curr_corridor != nullptr)
+            npc_rs.corridor_center = npc.curr_corridor->bb.center();
+        }
+      }
+      
+      for_each_item(floor_bucket, [&](const auto& obj)
+      {
+        if (obj.curr_floor != curr_floor || !obj.visible)
+          return;
+        auto fg_color = obj.style.fg_color;
+        if (obj.shade && obj.light)
+          fg_color = t8::shade_color(obj.style.fg_color,
+                                     t8::ShadeType::Dark);
+        snapshot.items.push_back({ obj.pos, obj.glyph, fg_color, obj.style.bg_color });
+      });
+      
+      for (const auto* door : m_environment->fetch_doors(curr_floor))
+      {
+        std::string door_ch = "^";
+        if (door->is_door)
+        {
+          if (door->is_open)
+            door_ch = "L";
+          else if (door->is_locked)
+            door_ch = "G";
+          else
+            door_ch = "D";
+        }
+        snapshot.doors.push_back({ door->pos, door_ch, (use_fog_of_war && door->fog_of_war) ? Color16::Black : (door->light ? Color16::Yellow : Color16::DarkYellow) });
+      }
+      
+      for (const auto* staircase : m_environment->fetch_staircases(curr_floor))
+        snapshot.staircases.push_back({ staircase->pos, (use_fog_of_war && staircase->fog_of_war) ? Color16::Black : (staircase->light ? Color16::LightGray : Color16::DarkGray) });
+      
+      for_each_blood_splat(floor_bucket, [&](const auto& bs)
+      {
+        if (bs.curr_floor == curr_floor)
+          snapshot.blood_splats.push_back({ bs.pos, bs.shape, bs.visible, bs.alive, bs.terrain });
+      });
+      
+      fetch_visible_projectiles(snapshot.projectiles);
+      snapshot.fights = m_fight_marks;
+      
+      fetch_health_bars(snapshot.health_bars);
+      snapshot.pc_strength = m_player.strength;
+      snapshot.pc_weakness = m_player.weakness;
+      snapshot.show_inventory = m_player.show_inventory;
+      if (snapshot.show_inventory)
+        m_inventory->fetch_lines(snapshot.inventory_lines);
+      
+      m_back_render_snapshot = m_ready_render_snapshot.exchange(m_back_render_snapshot | c_render_snapshot_fresh)
+        & ~c_render_snapshot_fresh;
+    }
+    
+    // Full : Near the PC or hostile.
+    // Coarse : On the floor of the PC but out of reach of it.
+    // Suspended : On another floor.
+    NPCSimLOD calc_npc_sim_lod(const NPC& npc) const
+    {
+      if (npc.curr_floor != m_player.curr_floor)
+        return NPCSimLOD::Suspended;
+      if (npc.is_hostile || npc.health <= 0)
+        return NPCSimLOD::Full;
+      // Anything that may start to pursue the PC within the next few frames.
+      const int c_margin = static_cast<int>(std::ceil(NPC::c_dist_patroll));
+      if (m_screen_helper->is_on_screen(npc.pos, m_screen_helper->get_screen_size(), c_margin))
+        return NPCSimLOD::Full;
+      return NPCSimLOD::Coarse;
+    }
+    
+    // Rooms and corridors of the floor, with the doors as they currently are.
+    void bake_pursuit_field(int floor)
+    {
+      auto& field = m_pursuit_fields[floor];
+      field.reset(m_environment->get_world_size(floor));
+      auto f_bake_cell = [&](const RC& pos)
+      {
+        if (m_environment->allow_move_to(floor, pos.r, pos.c))
+          field.set_walkable(pos, true);
+      };
+      std::vector<BSPNode*> rooms;
+      for (const auto& [room_pair, corr] : m_environment->get_room_corridor_map(floor))
+      {
+        for (auto* room : { room_pair.first, room_pair.second })
+          if (!stlutils::contains(rooms, room))
+            rooms.emplace_back(room);
+        const auto& bb = corr->bb;
+        for (int r = bb.top(); r <= bb.bottom(); ++r)
+          for (int c = bb.left(); c <= bb.right(); ++c)
+            if (corr->is_inside_corridor({ r, c }))
+              f_bake_cell({ r, c });
+      }
+      for (const auto* room : rooms)
+      {
+        const auto& bb = room->bb_leaf_room;
+        for (int r = bb.top() + 1; r < bb.bottom(); ++r)
+          for (int c = bb.left() + 1; c < bb.right(); ++c)
+            f_bake_cell({ r, c });
+      }
+      refresh_pursuit_field_doors(floor);
+      field.set_baked();
+    }
+    
+    void refresh_pursuit_field_doors(int floor)
+    {
+      auto& field = m_pursuit_fields[floor];
+      for (const auto* door : m_environment->fetch_doors(floor))
+        field.set_walkable(door->pos, door->open_or_no_door()
+                                      && m_environment->allow_move_to(floor, door->pos.r, door->pos.c));
+    }
+    
+    // Called before the NPCs are ticked, which then only read the field.
+    void update_pursuit_field()
+    {
+      const int floor = m_player.curr_floor;
+      if (stlutils::sizeI(m_pursuit_fields) != m_environment->num_floors())
+        m_pursuit_fields.assign(m_environment->num_floors(), {});
+      if (!stlutils::in_range(m_pursuit_fields, floor))
+        return;
+      auto& field = m_pursuit_fields[floor];
+      const int num_door_state_changes = m_keyboard->get_num_door_state_changes();
+      bool doors_changed = floor != m_pursuit_field_floor
+        || num_door_state_changes != m_pursuit_field_door_state_changes;
+      if (!field.is_baked())
+        bake_pursuit_field(floor);
+      else if (doors_changed)
+        refresh_pursuit_field_doors(floor);
+      if (doors_changed || field.get_target() != m_player.pos)
+        field.compute(m_player.pos, c_pursuit_field_max_dist);
+      m_pursuit_field_floor = floor;
+      m_pursuit_field_door_state_changes = num_door_state_changes;
+    }
+    
+    FrameInputs calc_frame_inputs() const
+    {
+      FrameInputs inputs;
+      inputs.scr_world_pos = m_screen_helper->get_world_pos({ 0, 0 });
+      inputs.visibility_inputs = m_visibility_inputs;
+      inputs.num_handled_keys = m_keyboard->get_num_handled_keys();
+      inputs.pc_health = m_player.health;
+      inputs.pc_strength = m_player.strength;
+      inputs.pc_show_inventory = m_player.show_inventory;
+      inputs.texture_anim_ctr = m_environment->get_texture_anim_ctr();
+      return inputs;
+    }
+    
+    // Returns true if any NPC on the floor of the PC changed since the last call.
+    bool update_npc_frame_inputs()
+    {
+      bool changed = false;
+      size_t num_inputs = 0;
+      for (const auto& npc : all_npcs)
+      {
+        if (npc.curr_floor != m_player.curr_floor)
+          continue;
+        NPCFrameInputs npc_inputs { npc.pos, npc.visible, npc.is_hostile, npc.health };
+        if (num_inputs == m_npc_frame_inputs.size())
+        {
+          m_npc_frame_inputs.emplace_back(npc_inputs);
+          changed = true;
+        }
+        else if (m_npc_frame_inputs[num_inputs] != npc_inputs)
+        {
+          m_npc_frame_inputs[num_inputs] = npc_inputs;
+          changed = true;
+        }
+        num_inputs++;
+      }
+      if (num_inputs != m_npc_frame_inputs.size())
+      {
+        m_npc_frame_inputs.resize(num_inputs);
+        changed = true;
+      }
+      return changed;
+    }
+    
+    static float calc_npc_death_anim_duration(bool can_fly)
+    {
+      return 1.5f + (can_fly ? 0.5f : 0.f);
+    }
+    
+    // Things that change the frame even when nothing else does.
+    bool is_animating(double real_time_s, float sim_time_s)
+    {
+      auto last_message_time_s = message_handler->get_last_message_time();
+      if (last_message_time_s.has_value() && static_cast<float>(real_time_s) - last_message_time_s.value() < c_message_linger_s)
+        return true;
+      if (!active_projectiles.empty())
+        return true;
+      if (m_player.has_fire_smoke(sim_time_s))
+        return true;
+      for (const auto& npc : all_npcs)
+      {
+        if (npc.curr_floor != m_player.curr_floor)
+          continue;
+        if (npc.is_hostile)
+          return true; // Fight animation.
+        if (npc.health <= 0 && sim_time_s - npc.death_time_s < calc_npc_death_anim_duration(npc.can_fly))
+          return true;
+      }
+      bool has_live_blood_splats = false;
+      for_each_blood_splat(m_entity_index.fetch_floor_bucket(m_player.curr_floor),
+        [&](const auto& bs) { has_live_blood_splats |= bs.alive; });
+      return has_live_blood_splats;
+    }
+    
+    void update_frame_dirty(double real_time_s, float sim_time_s)
+    {
+      auto frame_inputs = calc_frame_inputs();
+      bool npcs_changed = update_npc_frame_inputs();
+      m_frame_dirty = npcs_changed || m_frame_inputs != frame_inputs || is_animating(real_time_s, sim_time_s);
+      if (m_frame_dirty)
+      {
+        m_frame_inputs = std::move(frame_inputs);
+        m_frame_generation++;
+      }
+    }
+    
+    void invalidate_visibilities()
+    {
+      m_visibility_inputs.reset();
+      m_frame_inputs.reset();
+      m_refresh_visibilities = true;
+    }
+    
     template<typename T>
-    bool calc_night(const T& obj)
+    bool calc_night(const T& obj) const
     {
       bool is_night = false;
       if (m_use_per_room_lat_long_for_sun_dir)
       {
         auto f_set_night = [&](const RoomStyle& rs)
         {
-          if (m_solar_motion.get_solar_direction(rs.latitude, rs.longitude, m_season, m_t_solar_period) == SolarDirection::Nadir)
+          if (m_solar_dirs.is_night(rs.latitude, rs.longitude))
             is_night = true;
         };
         
-        auto room_style = m_environment->find_room_style(obj.curr_floor, obj.curr_room);
-        if (room_style.has_value())
-          f_set_night(room_style.value());
+        const auto* room_style = m_environment->find_room_style(obj.curr_floor, obj.curr_room);
+        if (room_style != nullptr)
+          f_set_night(*room_style);
         else
         {
-          auto corr_style = m_environment->find_corridor_style(obj.curr_floor, obj.curr_corridor);
-          if (corr_style.has_value())
-            f_set_night(corr_style.value());
+          const auto* corr_style = m_environment->find_corridor_style(obj.curr_floor, obj.curr_corridor);
+          if (corr_style != nullptr)
+            f_set_night(*corr_style);
         }
       }
       else
@@ -547,7 +1127,8 @@ namespace dung
       return is_night;
     };
     
-    void set_visibilities(float fow_radius, const RC& pc_pos)
+    // NPCs move on their own, so only they are updated when the items and blood splats don't need a refresh.
+    void set_visibilities(float fow_radius, const RC& pc_pos, bool refresh_items)
     {
       const auto c_fow_radius_sq = math::sq(fow_radius);
       
@@ -556,30 +1137,23 @@ namespace dung
         return distance_squared(obj.pos, pc_pos) <= c_fow_radius_sq;
       };
             
-      for (auto& key : all_keys)
-        key.set_visibility(use_fog_of_war, f_fow_near(key), calc_night(key));
+      // #NOTE: Entities on the other floors are not drawn, so they are updated once the PC gets there.
+      const auto& floor_bucket = m_entity_index.fetch_floor_bucket(m_player.curr_floor);
       
-      for (auto& lamp : all_lamps)
-        lamp.set_visibility(use_fog_of_war, f_fow_near(lamp), calc_night(lamp));
+      for (int npc_idx : floor_bucket.npc_idcs)
+      {
+        auto& npc = all_npcs[npc_idx];
+        npc.set_visibility(use_fog_of_war, f_fow_near(npc), calc_night(npc));
+      }
       
-      for (auto& weapon : all_weapons)
-        weapon->set_visibility(use_fog_of_war, f_fow_near(*weapon), calc_night(*weapon));
+      if (!refresh_items)
+        return;
       
-      for (auto& potion : all_potions)
-        potion.set_visibility(use_fog_of_war, f_fow_near(potion), calc_night(potion));
-        
-      for (auto& armour : all_armour)
-        armour->set_visibility(use_fog_of_war, f_fow_near(*armour), calc_night(*armour));
-        
-      for (auto& npc : all_npcs)
-        npc.set_visibility(use_fog_of_war, f_fow_near(npc), calc_night(npc));
+      for_each_item(floor_bucket, [&](auto& obj)
+        { obj.set_visibility(use_fog_of_war, f_fow_near(obj), calc_night(obj)); });
         
-      for (auto& bs : m_player.blood_splats)
-        bs.set_visibility(use_fog_of_war, calc_night(bs));
-      
-      for (auto& npc : all_npcs)
-        for (auto& bs : npc.blood_splats)
-          bs.set_visibility(use_fog_of_war, calc_night(bs));
+      for_each_blood_splat(floor_bucket, [&](auto& bs)
+        { bs.set_visibility(use_fog_of_war, calc_night(bs)); });
     }
     
     Weapon* get_selected_melee_weapon(PlayerBase* player) const
@@ -609,37 +1183,40 @@ namespace dung
       return { pc_melee_attack, pc_ranged_attack };
     }
     
-    template<int NR, int NC, typename CharT>
-    void draw_health_bars(ScreenHandler<NR, NC, CharT>& sh, bool framed_mode)
+    void fetch_health_bars(std::vector<HealthBarRenderState>& health_bars)
     {
-      std::vector<t8::GlyphString> health_bars;
-      std::vector<Style> styles;
-      std::vector<std::pair<RC, Style>> per_textel_styles;
-      auto pc_hb = t8::GlyphString::from_ascii(str::rep_char(' ', 10));
-      float pc_ratio = globals::max_health / 10.f;
-      for (int i = 0; i < 10; ++i)
-        pc_hb[i] = m_player.health > static_cast<int>(i*pc_ratio) ? t8::Glyph { 0x2592, '#' } : ' ';
-      pc_hb = m_player.glyph + ' ' + pc_hb;
-      per_textel_styles.emplace_back(RC { 0, 0 }, m_player.style);
-      health_bars.emplace_back(pc_hb);
-      styles.emplace_back(Style { Color16::Magenta, Color16::Transparent2 });
-      
-      int line = 1;
+      health_bars.push_back({ m_player.glyph, m_player.style, m_player.health, true });
       for (const auto& npc : all_npcs)
       {
         auto [pc_melee_attack, pc_ranged_attack] = get_pc_attack_modes(npc);
         if (npc.health > 0 && (npc.state == State::FightMelee || npc.state == State::FightRanged || pc_melee_attack || pc_ranged_attack))
         {
-          auto npc_hb = t8::GlyphString::from_ascii(str::rep_char(' ', 10));
-          float npc_ratio = globals::max_health / 10.f;
-          for (int i = 0; i < 10; ++i)
-            npc_hb[i] = npc.health > static_cast<int>(i*npc_ratio) ? t8::Glyph { 0x2592, 'O' } : ' ';
-          npc_hb = (npc.visible ? npc.glyph : '?') + ' ' + npc_hb;
-          per_textel_styles.emplace_back(RC { line++, 0 }, npc.visible ? npc.style : Style { Color16::White, Color16::Transparent2 });
-          health_bars.emplace_back(npc_hb);
-          styles.emplace_back(Style { Color16::Red, Color16::Transparent2 });
+          if (npc.visible)
+            health_bars.push_back({ npc.glyph, npc.style, npc.health, false });
+          else
+            health_bars.push_back({ '?', Style { Color16::White, Color16::Transparent2 }, npc.health, false });
         }
       }
+    }
+    
+    template<int NR, int NC, typename CharT>
+    void draw_health_bars(ScreenHandler<NR, NC, CharT>& sh, const RenderSnapshot& snapshot, bool framed_mode)
+    {
+      std::vector<t8::GlyphString> health_bars;
+      std::vector<Style> styles;
+      std::vector<std::pair<RC, Style>> per_textel_styles;
+      int line = 0;
+      for (const auto& hb_rs : snapshot.health_bars)
+      {
+        auto hb = t8::GlyphString::from_ascii(str::rep_char(' ', 10));
+        float ratio = globals::max_health / 10.f;
+        for (int i = 0; i < 10; ++i)
+          hb[i] = hb_rs.health > static_cast<int>(i*ratio) ? t8::Glyph { 0x2592, hb_rs.is_pc ? '#' : 'O' } : ' ';
+        hb = hb_rs.glyph + ' ' + hb;
+        per_textel_styles.emplace_back(RC { line++, 0 }, hb_rs.style);
+        health_bars.emplace_back(hb);
+        styles.emplace_back(hb_rs.is_pc ? Style { Color16::Magenta, Color16::Transparent2 } : Style { Color16::Red, Color16::Transparent2 });
+      }
       
       t8x::TextBoxDrawingArgsAlign tb_args;
       tb_args.v_align = t8x::VerticalAlignment::TOP;
@@ -652,7 +1229,7 @@ namespace dung
     }
     
     template<int NR, int NC, typename CharT>
-    void draw_strength_bar(ScreenHandler<NR, NC, CharT>& sh, bool framed_mode)
+    void draw_strength_bar(ScreenHandler<NR, NC, CharT>& sh, const RenderSnapshot& snapshot, bool framed_mode)
     {
       t8x::TextBoxDrawingArgsPos tb_args;
       int offs = framed_mode ? 1 : 0;
@@ -661,9 +1238,9 @@ namespace dung
       tb_args.base.outline_type = t8x::OutlineType::Unicode_SingleLineRounded;
     
       auto strength_bar = t8::GlyphString::from_ascii(str::rep_char(' ', 10));
-      float pc_ratio = m_player.strength / 10.f;
+      float pc_ratio = snapshot.pc_strength / 10.f;
       for (int i = 0; i < 10; ++i)
-        strength_bar[i] = (m_player.strength - m_player.weakness) > static_cast<int>(i*pc_ratio)
+        strength_bar[i] = (snapshot.pc_strength - snapshot.pc_weakness) > static_cast<int>(i*pc_ratio)
         ? t8::Glyph { 0x2550, '=' } : ' ';
       Style style { Color16::Green, Color16::Transparent2 };
       tb_strength.set_text(strength_bar, style);
@@ -884,10 +1461,12 @@ namespace dung
       }
     }
     
-    template<int NR, int NC, typename CharT>
-    void draw_fighting(ScreenHandler<NR, NC, CharT>& sh, const RC& pc_scr_pos, bool do_update_fight, float real_time_s, float sim_time_s,
-                       int melee_blood_prob_visible, int melee_blood_prob_invisible)
+    // Blood splats, fight messages and the symbols of the melee fights, see m_fight_marks.
+    void update_fight_effects(bool do_update_fight, float real_time_s, float sim_time_s,
+                              int melee_blood_prob_visible, int melee_blood_prob_invisible)
     {
+      m_fight_marks.clear();
+      
       auto f_render_pc_blood_splats = [&](const RC& offs)
       {
         auto& bs = m_player.blood_splats.emplace_back(m_environment.get(), m_player.curr_floor, m_player.pos + offs, rnd::dice(4), sim_time_s, offs);
@@ -897,6 +1476,7 @@ namespace dung
           bs.is_underground = m_environment->is_underground(m_player.curr_floor, m_player.curr_room);
         else if (m_player.is_inside_curr_corridor())
           bs.is_underground = m_environment->is_underground(m_player.curr_floor, m_player.curr_corridor);
+        m_entity_index.insert_blood_splat(-1, stlutils::sizeI(m_player.blood_splats) - 1, bs);
       };
       
       auto f_render_npc_blood_splats = [&](NPC& npc, const RC& offs)
@@ -905,6 +1485,8 @@ namespace dung
         bs.curr_room = npc.curr_room;
         bs.curr_corridor = npc.curr_corridor;
         bs.is_underground = npc.is_underground;
+        auto npc_idx = static_cast<int>(&npc - all_npcs.data());
+        m_entity_index.insert_blood_splat(npc_idx, stlutils::sizeI(npc.blood_splats) - 1, bs);
       };
       
       if (m_player.health > 0)
@@ -942,8 +1524,6 @@ namespace dung
           
           if (npc.state == State::FightMelee)
           {
-            auto npc_scr_pos = m_screen_helper->get_screen_pos(npc.pos);
-            
             // [side_case, base_case, side_case]
             // Case NW (dp = [1, 1]):
             //O#
@@ -1030,7 +1610,7 @@ namespace dung
                 fight_c_offs[(dir + 1)%num_dir] });
               return RC { r_offs, c_offs };
             };
-            auto f_render_fight = [&](PlayerBase* pb, const RC& scr_pos, const RC& offs)
+            auto f_render_fight = [&](PlayerBase* pb, const RC& pos, const RC& offs)
             {
               // #FIXME:
               if (do_update_fight)
@@ -1042,26 +1622,20 @@ namespace dung
                 };
                 pb->cached_fight_str = rnd::rand_select(c_fight_strings);
               }
-              auto fight_style = pb->cached_fight_style;
-              auto fight_str = pb->cached_fight_str;
-              
-              sh.write_buffer(fight_str,
-                              scr_pos.r + offs.r,
-                              scr_pos.c + offs.c,
-                              fight_style);
+              m_fight_marks.push_back({ pos + offs, pb->cached_fight_str, pb->cached_fight_style });
             };
             if (do_update_fight)
               m_player.cached_fight_offs = f_calc_fight_offs(dp);
             auto offs = m_player.cached_fight_offs;
             if (m_environment->is_inside_any_room(m_player.curr_floor, m_player.pos + offs))
-              f_render_fight(&m_player, npc_scr_pos, offs);
+              f_render_fight(&m_player, npc.pos, offs);
             if (npc.visible)
             {
               if (do_update_fight)
                 npc.cached_fight_offs = f_calc_fight_offs(-dp);
               auto offs = npc.cached_fight_offs;
               if (m_environment->is_inside_any_room(npc.curr_floor, npc.pos + offs))
-                f_render_fight(&npc, pc_scr_pos, offs);
+                f_render_fight(&npc, m_player.pos, offs);
             }
           }
 
@@ -1088,47 +1662,46 @@ namespace dung
           }
         }
       }
-      
+    }
+    
+    // Projectiles that hit their target are drawn once more before they are removed.
+    void remove_finished_projectiles(float sim_time_s)
+    {
+      stlutils::erase_if(active_projectiles, [sim_time_s](const auto& p)
+      {
+        return p.hit
+            || p.travel_time.finished(sim_time_s)
+            || (p.curr_room != nullptr && p.curr_room->bb_leaf_room.find_location(t8::to_RC_round(p.pos)) != t8::BBLocation::Inside);
+      });
+    }
+    
+    void fetch_visible_projectiles(std::vector<ProjectileRenderState>& projectiles) const
+    {
       for (const auto& p : active_projectiles)
       {
-        t8::Glyph p_char = p.weapon->projectile_glyphs[p.ang_idx];
-        
         const RC& wpn_pos = t8::to_RC_round(p.pos);
         
-        const RC& wpn_scr_pos = m_screen_helper->get_screen_pos(wpn_pos);
-        
         bool light = false;
         bool fog_of_war = true;
         if (p.curr_room != nullptr)
         {
-          const auto& bb = p.curr_room->bb_leaf_room;
-          int idx = (wpn_pos.r - bb.r)*bb.c_len + (wpn_pos.c - bb.c);
-          light = p.curr_room->light[idx];
-          fog_of_war = p.curr_room->fog_of_war[idx];
+          light = p.curr_room->is_in_light(wpn_pos);
+          fog_of_war = p.curr_room->is_in_fog_of_war(wpn_pos);
         }
         else if (p.curr_corridor != nullptr)
         {
-          const auto& bb = p.curr_corridor->bb;
-          int idx = (wpn_pos.r - bb.r)*bb.c_len + (wpn_pos.c - bb.c);
-          light = p.curr_corridor->light[idx];
-          fog_of_war = p.curr_corridor->fog_of_war[idx];
+          light = p.curr_corridor->is_in_light(wpn_pos);
+          fog_of_war = p.curr_corridor->is_in_fog_of_war(wpn_pos);
         }
         bool visible = !((use_fog_of_war && fog_of_war) ||
                       ((m_environment->is_underground(p.curr_floor, p.curr_room) || calc_night(p)) && !light)); // #FIXME: add fow term.
         if (visible)
-          sh.write_buffer(p_char, wpn_scr_pos, p.weapon->projectile_fg_color, Color16::Transparent2);
+          projectiles.push_back({ wpn_pos, p.weapon->projectile_glyphs[p.ang_idx], p.weapon->projectile_fg_color });
       }
-      stlutils::erase_if(active_projectiles, [sim_time_s](const auto& p)
-      {
-        return p.hit
-            || p.travel_time.finished(sim_time_s)
-            || (p.curr_room != nullptr && p.curr_room->bb_leaf_room.find_location(t8::to_RC_round(p.pos)) != t8::BBLocation::Inside);
-      });
     }
     
-    void assign_room_properties(Item& item, const std::optional<RoomStyle>& rs, bool assure_contrasting_fg_colors)
+    void assign_room_properties(Item& item, const RoomStyle& room_style, bool assure_contrasting_fg_colors)
     {
-      const auto& room_style = rs.value();
       item.is_underground = room_style.is_underground;
       if (assure_contrasting_fg_colors)
       {
@@ -1150,7 +1723,7 @@ namespace dung
       m_keyboard = std::make_unique<Keyboard>(m_environment.get(), m_inventory.get(), message_handler.get(),
                                               m_player,
                                               all_keys, all_lamps, all_weapons, all_potions, all_armour,
-                                              all_npcs,
+                                              all_npcs, m_entity_index,
                                               trigger_game_save, trigger_game_load, trigger_screenshot,
                                               tbd, debug);
       if (sorted_inventory_items)
@@ -1166,6 +1739,17 @@ namespace dung
       all_weapons.clear();
       all_potions.clear();
       all_armour.clear();
+      m_entity_index.reset(m_environment->num_floors());
+      m_static_light_maps.reset(m_environment->num_floors());
+      m_static_light_lamp_generation = -1;
+      m_light_floor = -1;
+      m_light_room = nullptr;
+      m_light_corridor = nullptr;
+      m_npc_sim_lod_floor = -1;
+      m_pursuit_fields.clear();
+      m_pursuit_field_floor = -1;
+      m_path_finder.clear();
+      invalidate_visibilities();
     }
     
     void style_dungeon(WallShadingType wall_shading_surface_level,
@@ -1286,9 +1870,58 @@ namespace dung
       m_sun_minutes_per_day = minutes_per_day;
       m_sun_day_t_offs = math::clamp(sun_day_t_offs, 0.f, 1.f);
       m_sun_dir = m_solar_motion.get_solar_direction(m_latitude, m_longitude, m_season, m_sun_day_t_offs);
+      m_solar_dirs.update(m_solar_motion, m_season, m_sun_day_t_offs);
       m_use_per_room_lat_long_for_sun_dir = use_per_room_lat_long_for_sun_dir;
     }
     
+    // NPCs out of reach of the PC are ticked at a lower rate and NPCs on other floors not at all.
+    // The latter catch up in a statistical sense when the PC arrives on their floor.
+    void configure_npc_sim_lod(bool use_npc_sim_lod)
+    {
+      m_use_npc_sim_lod = use_npc_sim_lod;
+      m_npc_sim_lod_floor = -1;
+    }
+    
+    // Splits the NPC update over num_threads worker threads and the calling thread.
+    // The simulation is the same for any number of threads.
+    void configure_npc_threads(int num_threads)
+    {
+      m_npc_workers.reset(std::max(0, num_threads));
+    }
+    
+    // For routes between any two cells of the dungeon, possibly on different floors.
+    // Built from the rooms, corridors, doors and staircases on the first call,
+    //   so don't call it before the dungeon has been styled.
+    // Rebuilt on the next call after Dungeon::create_staircases(), so it may be called in between.
+    const PathFinder& get_path_finder()
+    {
+      int staircase_generation = m_environment->get_dungeon()->get_staircase_generation();
+      if (!m_path_finder.is_built() || m_path_finder_staircase_generation != staircase_generation)
+      {
+        m_path_finder.build(*m_environment);
+        m_path_finder_staircase_generation = staircase_generation;
+      }
+      return m_path_finder;
+    }
+    
+    // Lamps that lie on the floor (not picked up and not burnt out) will light up
+    //   the room or the corridor they are in, just as the lamp of the PC.
+    void configure_light_sources(bool placed_lamps_emit_light)
+    {
+      m_placed_lamps_emit_light = placed_lamps_emit_light;
+      m_static_light_lamp_generation = -1;
+      m_static_light_maps.reset(m_environment->num_floors());
+    }
+    
+    // Splits the composition of the static environment layer in draw() into horizontal bands
+    //   of the screen, each band beyond the first one running on a worker thread of its own.
+    // Only runs when the layer is stale, e.g. on scrolling or when the fog of war or light changes.
+    // Pays off for wide screens. The frame is the same for any number of bands.
+    void configure_draw_bands(int num_bands)
+    {
+      m_environment->set_num_draw_bands(num_bands);
+    }
+    
     bool place_keys(bool only_place_on_dry_land, bool assure_contrasting_fg_colors, bool only_place_on_same_floor)
     {
       const int c_max_num_iters = 1e5_i;
@@ -1329,9 +1962,9 @@ namespace dung
             
             if (key.curr_room != nullptr)
             {
-              auto rs = m_environment->find_room_style(key.curr_floor, key.curr_room);
-              if (rs.has_value())
-                assign_room_properties(key, rs, assure_contrasting_fg_colors);
+              const auto* rs = m_environment->find_room_style(key.curr_floor, key.curr_room);
+              if (rs != nullptr)
+                assign_room_properties(key, *rs, assure_contrasting_fg_colors);
               else
               {
                 std::cerr << "ERROR in place_keys() : Unable to find room style for placed key!\n";
@@ -1348,6 +1981,7 @@ namespace dung
           }
         }
       }
+      rebuild_entity_index();
       return true;
     }
     
@@ -1408,9 +2042,9 @@ namespace dung
           
           if (lamp.curr_room != nullptr)
           {
-            auto rs = m_environment->find_room_style(lamp.curr_floor, lamp.curr_room);
-            if (rs.has_value())
-              assign_room_properties(lamp, rs, assure_contrasting_fg_colors);
+            const auto* rs = m_environment->find_room_style(lamp.curr_floor, lamp.curr_room);
+            if (rs != nullptr)
+              assign_room_properties(lamp, *rs, assure_contrasting_fg_colors);
             else
             {
               std::cerr << "ERROR in place_lamps() : Unable to find room style for placed lamp!\n";
@@ -1426,6 +2060,7 @@ namespace dung
           all_lamps.emplace_back(lamp);
         }
       }
+      rebuild_entity_index();
       return true;
     }
     
@@ -1497,9 +2132,9 @@ namespace dung
           
           if (weapon->curr_room != nullptr)
           {
-            auto rs = m_environment->find_room_style(weapon->curr_floor, weapon->curr_room);
-            if (rs.has_value())
-              assign_room_properties(*weapon.get(), rs, assure_contrasting_fg_colors);
+            const auto* rs = m_environment->find_room_style(weapon->curr_floor, weapon->curr_room);
+            if (rs != nullptr)
+              assign_room_properties(*weapon.get(), *rs, assure_contrasting_fg_colors);
             else
             {
               std::cerr << "ERROR in place_weapons() : Unable to find room style for placed weapon!\n";
@@ -1515,6 +2150,7 @@ namespace dung
           all_weapons.emplace_back(weapon.release());
         }
       }
+      rebuild_entity_index();
       return true;
     }
     
@@ -1557,9 +2193,9 @@ namespace dung
           
           if (potion.curr_room != nullptr)
           {
-            auto rs = m_environment->find_room_style(potion.curr_floor, potion.curr_room);
-            if (rs.has_value())
-              assign_room_properties(potion, rs, assure_contrasting_fg_colors);
+            const auto* rs = m_environment->find_room_style(potion.curr_floor, potion.curr_room);
+            if (rs != nullptr)
+              assign_room_properties(potion, *rs, assure_contrasting_fg_colors);
             else
             {
               std::cerr << "ERROR in place_potions() : Unable to find room style for placed potion!\n";
@@ -1575,6 +2211,7 @@ namespace dung
           all_potions.emplace_back(potion);
         }
       }
+      rebuild_entity_index();
       return true;
     }
     
@@ -1643,9 +2280,9 @@ namespace dung
           
           if (armour->curr_room != nullptr)
           {
-            auto rs = m_environment->find_room_style(armour->curr_floor, armour->curr_room);
-            if (rs.has_value())
-              assign_room_properties(*armour.get(), rs, assure_contrasting_fg_colors);
+            const auto* rs = m_environment->find_room_style(armour->curr_floor, armour->curr_room);
+            if (rs != nullptr)
+              assign_room_properties(*armour.get(), *rs, assure_contrasting_fg_colors);
             else
             {
               std::cerr << "ERROR in place_armour() : Unable to find room style for placed armour!\n";
@@ -1661,11 +2298,15 @@ namespace dung
           all_armour.emplace_back(armour.release());
         }
       }
+      rebuild_entity_index();
       return true;
     }
     
-    bool place_npcs(int num_npcs, bool only_place_on_dry_land)
+    // rnd_seed : seed of the game. The NPCs draw from random streams of their own that are derived from it,
+    //   so that the placement draws from the global rnd are the same as without them.
+    bool place_npcs(int num_npcs, bool only_place_on_dry_land, unsigned int rnd_seed)
     {
+      m_npc_rnd_seed = rnd_seed;
       const int c_max_num_iters = 1e5_i;
       const auto* dungeon = m_environment->get_dungeon();
       for (int f_idx = 0; f_idx < m_environment->num_floors(); ++f_idx)
@@ -1710,9 +2351,11 @@ namespace dung
             return false;
           }
           
+          npc.seed_rng(m_npc_rnd_seed, stlutils::sizeI(all_npcs));
           all_npcs.emplace_back(npc);
         }
       }
+      rebuild_entity_index();
       return true;
     }
     
@@ -1720,6 +2363,8 @@ namespace dung
                 double real_time_s, float sim_time_s, float sim_dt_s,
                 float fire_smoke_dt_factor, float projectile_speed_factor,
                 int melee_attack_dice, int ranged_attack_dice,
+                int anim_ctr_fight,
+                int melee_blood_prob_visible, int melee_blood_prob_invisible,
                 const t8::KeyPressDataPair& kpdp, bool* game_over)
     {
       utils::try_set(game_over, m_player.health <= 0);
@@ -1728,6 +2373,8 @@ namespace dung
         
       stall_game = m_player.show_inventory;
       
+      m_environment->update_texture_anim(real_time_s);
+      
       bool do_los_terrainos = frame_ctr % std::max(1, math::roundI(fps / 5)) == 0;
       bool do_npc_move = frame_ctr % std::max(1, math::roundI(fps / 4)) == 0;
       bool do_fight = frame_ctr % std::max(1, math::roundI(fps / 3)) == 0;
@@ -1742,30 +2389,78 @@ namespace dung
         math::minimize(fow_radius, globals::max_fow_radius);
       }
       
-      set_visibilities(fow_radius, m_player.pos);
+      set_visibilities(fow_radius, m_player.pos, m_refresh_visibilities);
+      m_refresh_visibilities = false;
       
       auto& curr_pos = m_player.pos;
       m_keyboard->handle_keyboard(kpdp, real_time_s);
       
       update_inventory();
       
+      poll_screenshot_export(real_time_s);
+      
       if (stall_game)
+      {
+        publish_render_snapshot(sim_time_s);
+        update_frame_dirty(real_time_s, sim_time_s);
         return;
+      }
       
-      // Fog of war
-      if (use_fog_of_war)
-        update_field(curr_pos,
-                     [](auto obj) { return &obj->fog_of_war; },
-                     false, fow_radius, 0.f, Lamp::LightType::Isotropic);
-                  
-      // Light
-      clear_field([](auto obj) { return &obj->light; }, false);
-      if (lamp != nullptr)
+      update_static_light();
+      
+      // The fields only change when the PC, the lamp, the doors, the sun or the entities near the PC do.
+      auto visibility_inputs = calc_visibility_inputs(fow_radius, lamp);
+      if (m_visibility_inputs != visibility_inputs)
       {
-        update_field(curr_pos,
-                     [](auto obj) { return &obj->light; },
-                     true, lamp->radius, lamp->angle_deg,
-                     lamp->light_type);
+        m_visibility_inputs = visibility_inputs;
+        m_refresh_visibilities = true;
+        
+        // Fog of war
+        if (use_fog_of_war)
+        {
+          update_field(curr_pos,
+                       [](auto obj) { return &obj->fog_of_war; },
+                       false, fow_radius, 0.f, Lamp::LightType::Isotropic);
+          // Rooms and corridors share the fog of war of the cells where they meet,
+          //   so the neighbours of the ones of the PC may have been cleared too.
+          auto f_refresh_fog_summary = [](auto* obj)
+          {
+            if (obj != nullptr && obj->fog_of_war.is_fully_fogged())
+              obj->fog_of_war.refresh_summary();
+          };
+          if (m_player.curr_room != nullptr)
+          {
+            f_refresh_fog_summary(m_player.curr_room);
+            for (auto* door : m_player.curr_room->doors)
+              f_refresh_fog_summary(door->corridor);
+          }
+          if (m_player.curr_corridor != nullptr)
+          {
+            f_refresh_fog_summary(m_player.curr_corridor);
+            for (auto* door : m_player.curr_corridor->doors)
+              if (door != nullptr)
+                f_refresh_fog_summary(door->room);
+          }
+        }
+                    
+        // Light
+        if (m_light_floor != m_player.curr_floor || m_light_room != m_player.curr_room || m_light_corridor != m_player.curr_corridor)
+        {
+          for_each_item_and_blood_splat_in(m_light_floor, m_light_room, m_light_corridor,
+            [&](auto& obj) { obj.light = m_static_light_maps.is_lit(m_light_floor, m_light_room, m_light_corridor, obj.pos); });
+          m_light_floor = m_player.curr_floor;
+          m_light_room = m_player.curr_room;
+          m_light_corridor = m_player.curr_corridor;
+        }
+        // The light of the PC lamp is composited on top of the baked light of the lamps lying around.
+        apply_static_light(m_player.curr_floor, m_player.curr_room, m_player.curr_corridor);
+        if (lamp != nullptr)
+        {
+          update_field(curr_pos,
+                       [](auto obj) { return &obj->light; },
+                       true, lamp->radius, lamp->angle_deg,
+                       lamp->light_type);
+        }
       }
       
       // Update current room and current corridor.
@@ -1806,12 +2501,119 @@ namespace dung
       {
         BSPNode* pc_room = m_player.is_inside_curr_room() ? m_player.curr_room : nullptr;
         Corridor* pc_corr = m_player.is_inside_curr_corridor() ? m_player.curr_corridor : nullptr;
-        for (auto& npc : all_npcs)
+        // NPCs on the floor that the PC just arrived on make up for the time they were suspended.
+        if (m_use_npc_sim_lod && m_npc_sim_lod_floor != m_player.curr_floor)
         {
-          npc.on_terrain = m_environment->get_terrain(npc.curr_floor, npc.pos);
-          npc.update(curr_pos, pc_room, pc_corr, m_environment.get(),
-                     do_los_terrainos, do_npc_move,
-                     sim_time_s, sim_dt_s);
+          if (m_npc_sim_lod_floor != -1)
+          {
+            for (int npc_idx = 0; npc_idx < stlutils::sizeI(all_npcs); ++npc_idx)
+            {
+              auto& npc = all_npcs[npc_idx];
+              if (npc.curr_floor != m_player.curr_floor)
+                continue;
+              npc.catch_up(m_environment.get(), sim_time_s);
+              m_entity_index.relocate(EntityType::NPC, npc_idx, npc);
+            }
+          }
+          m_npc_sim_lod_floor = m_player.curr_floor;
+        }
+        update_pursuit_field();
+        const auto* pursuit_field = stlutils::in_range(m_pursuit_fields, m_player.curr_floor) ?
+          &m_pursuit_fields[m_player.curr_floor] : nullptr;
+        
+        // Schedule.
+        const int num_npcs = stlutils::sizeI(all_npcs);
+        m_npc_ticks.assign(num_npcs, {});
+        for (int npc_idx = 0; npc_idx < num_npcs; ++npc_idx)
+        {
+          auto& tick = m_npc_ticks[npc_idx];
+          tick.do_tick = true;
+          tick.do_los_terrainos = do_los_terrainos;
+          tick.dt = sim_dt_s;
+          if (m_use_npc_sim_lod)
+          {
+            switch (calc_npc_sim_lod(all_npcs[npc_idx]))
+            {
+              case NPCSimLOD::Full:
+                break;
+              case NPCSimLOD::Coarse:
+                // Staggered, so that only a fraction of them are ticked each frame.
+                tick.do_tick = (frame_ctr + npc_idx) % c_npc_coarse_tick_interval == 0;
+                tick.do_los_terrainos = true;
+                tick.dt = sim_dt_s * c_npc_coarse_tick_interval;
+                break;
+              case NPCSimLOD::Suspended:
+                tick.do_tick = false;
+                break;
+            }
+          }
+        }
+        
+        // Tick. Each NPC only writes to itself and only reads the world.
+        // Steering, then integration of all the NPCs in one batch and then the terrain and collision checks.
+        // #NOTE: NPCs draw from their own RandomStream, so the outcome is the same for any number of threads.
+        const int num_tasks = m_npc_workers.num_threads() + 1;
+        auto f_for_each_range = [&](int num, auto f_range)
+        {
+          m_npc_workers.parallel_for(num_tasks, [&](int task_idx)
+          {
+            f_range(task_idx * num / num_tasks, (task_idx + 1) * num / num_tasks);
+          });
+        };
+        f_for_each_range(num_npcs, [&](int idx_start, int idx_end)
+        {
+          for (int npc_idx = idx_start; npc_idx < idx_end; ++npc_idx)
+          {
+            auto& tick = m_npc_ticks[npc_idx];
+            if (!tick.do_tick)
+              continue;
+            auto& npc = all_npcs[npc_idx];
+            npc.on_terrain = m_environment->get_terrain(npc.curr_floor, npc.pos);
+            tick.moves = npc.update_pre(curr_pos, pc_room, pc_corr,
+                                        npc.curr_floor == m_player.curr_floor ? pursuit_field : nullptr,
+                                        tick.do_los_terrainos, do_npc_move,
+                                        sim_time_s, tick.dt);
+          }
+        });
+        // Only the NPCs that move are staged for the integration, so that the ones that are suspended,
+        //   skipped or standing still cost nothing.
+        m_npc_moving_idcs.clear();
+        for (int npc_idx = 0; npc_idx < num_npcs; ++npc_idx)
+          if (m_npc_ticks[npc_idx].moves)
+            m_npc_moving_idcs.emplace_back(npc_idx);
+        const int num_moving = stlutils::sizeI(m_npc_moving_idcs);
+        m_npc_kinematics.resize(num_moving);
+        f_for_each_range(num_moving, [&](int slot_start, int slot_end)
+        {
+          for (int slot = slot_start; slot < slot_end; ++slot)
+          {
+            int npc_idx = m_npc_moving_idcs[slot];
+            all_npcs[npc_idx].store_kinematics(m_npc_kinematics, slot, m_npc_ticks[npc_idx].dt);
+          }
+          m_npc_kinematics.integrate(slot_start, slot_end);
+          for (int slot = slot_start; slot < slot_end; ++slot)
+            all_npcs[m_npc_moving_idcs[slot]].load_kinematics(m_npc_kinematics, slot);
+        });
+        f_for_each_range(num_npcs, [&](int idx_start, int idx_end)
+        {
+          for (int npc_idx = idx_start; npc_idx < idx_end; ++npc_idx)
+          {
+            const auto& tick = m_npc_ticks[npc_idx];
+            if (!tick.do_tick)
+              continue;
+            auto& npc = all_npcs[npc_idx];
+            npc.update_post(m_environment.get(), tick.moves);
+            npc.last_tick_time_s = sim_time_s;
+          }
+        });
+        
+        // Merge, in NPC order.
+        for (int npc_idx = 0; npc_idx < num_npcs; ++npc_idx)
+        {
+          if (!m_npc_ticks[npc_idx].do_tick)
+            continue;
+          auto& npc = all_npcs[npc_idx];
+          m_entity_index.relocate(EntityType::NPC, npc_idx, npc);
         
           if (npc.is_hostile && !npc.was_hostile)
             broadcast([&npc](auto* listener) { listener->on_fight_begin(&npc); });
@@ -1820,10 +2622,16 @@ namespace dung
         }
       }
       
+      for_each_blood_splat(m_entity_index.fetch_floor_bucket(m_player.curr_floor),
+                           [sim_time_s](auto& bs) { bs.update(sim_time_s); });
+      
+      remove_finished_projectiles(sim_time_s);
       if (do_fight)
         update_fighting(static_cast<float>(real_time_s), sim_time_s, sim_dt_s,
                         projectile_speed_factor,
                         melee_attack_dice, ranged_attack_dice);
+      update_fight_effects(anim_ctr_fight % 2 == 0, static_cast<float>(real_time_s), sim_time_s,
+                           melee_blood_prob_visible, melee_blood_prob_invisible);
         
       if (trigger_game_save)
       {
@@ -1860,22 +2668,47 @@ namespace dung
       }
       
       m_screen_helper->update_scrolling(curr_pos);
+      
+      publish_render_snapshot(sim_time_s);
+      update_frame_dirty(real_time_s, sim_time_s);
     }
     
+    // Bumped by update() whenever the next call to draw() would give a different frame.
+    // A host may skip draw() (and keep presenting the previous frame) while it stays the same.
+    int get_frame_generation() const { return m_frame_generation; }
+    bool is_frame_dirty() const { return m_frame_dirty; }
+    
     
     template<int NR, int NC, typename CharT>
     void draw(ScreenHandler<NR, NC, CharT>& sh, double real_time_s, float sim_time_s,
-              int anim_ctr_swim, int anim_ctr_fight,
-              int melee_blood_prob_visible, int melee_blood_prob_invisible,
+              int anim_ctr_swim,
               t8x::VerticalAlignment mb_v_align = t8x::VerticalAlignment::CENTER,
               t8x::HorizontalAlignment mb_h_align = t8x::HorizontalAlignment::CENTER,
               int mb_v_align_offs = 0, int mb_h_align_offs = 0,
               bool framed_mode = false,
               bool gore = false)
     {
-      const auto& room_corridor_map = m_environment->get_room_corridor_map(m_player.curr_floor);
-      const auto& door_vec = m_environment->fetch_doors(m_player.curr_floor);
-      const auto& staircase_vec = m_environment->fetch_staircases(m_player.curr_floor);
+      if ((m_ready_render_snapshot.load() & c_render_snapshot_fresh) != 0)
+        m_front_render_snapshot = m_ready_render_snapshot.exchange(m_front_render_snapshot) & ~c_render_snapshot_fresh;
+      const auto& snapshot = m_render_snapshots[m_front_render_snapshot];
+      const auto& scr_helper = snapshot.screen_helper;
+      // Everything outside of the screen is culled before it reaches the ScreenHandler.
+      const RC scr_size { NR, NC };
+      // Opaque textels written by this function, so that draw_environment() can skip them.
+      // Textels with a transparent background are not recorded, since the background of the environment shows through.
+      // #NOTE: The message box, the inventory and the HUD text boxes are laid out by Termin8or
+      //   and are left out. They are drawn before the environment, so they stay on top anyway.
+      m_drawn_cells.reset(NR, NC);
+      auto f_set_drawn = [this](const RC& scr_pos, const Color& bg_color)
+      {
+        if (bg_color != Color16::Transparent && bg_color != Color16::Transparent2)
+          m_drawn_cells.set(scr_pos.r, scr_pos.c, true);
+      };
+      auto f_set_drawn_rect = [this](int r, int c, int r_len, int c_len)
+      {
+        for (int r_idx = r; r_idx < r + r_len; ++r_idx)
+          m_drawn_cells.set_span(r_idx, c, c + c_len - 1, true);
+      };
       
       t8x::MessageBoxDrawingArgs mb_args;
       mb_args.v_align = mb_v_align;
@@ -1898,30 +2731,34 @@ namespace dung
         }
       }
         
-      if (m_player.show_inventory)
+      if (snapshot.show_inventory)
       {
         m_inventory->set_bounding_box({ 2, 2, NR - 5, NC - 5 });
-        m_inventory->draw(sh);
+        m_inventory->draw(sh, snapshot.inventory_lines);
       }
         
-      draw_health_bars(sh, framed_mode);
-      draw_strength_bar(sh, framed_mode);
+      draw_health_bars(sh, snapshot, framed_mode);
+      draw_strength_bar(sh, snapshot, framed_mode);
+      
+      auto pc_scr_pos = scr_helper.get_screen_pos(snapshot.pc.pos);
       
-      auto pc_scr_pos = m_screen_helper->get_screen_pos(m_player.pos);
+      for (const auto& fight : snapshot.fights)
+      {
+        auto fight_scr_pos = scr_helper.get_screen_pos(fight.pos);
+        sh.write_buffer(fight.str, fight_scr_pos.r, fight_scr_pos.c, fight.style);
+      }
       
-      draw_fighting(sh, pc_scr_pos, anim_ctr_fight % 2 == 0, static_cast<float>(real_time_s), sim_time_s,
-                    melee_blood_prob_visible, melee_blood_prob_invisible);
+      for (const auto& p : snapshot.projectiles)
+        sh.write_buffer(p.glyph, scr_helper.get_screen_pos(p.pos), p.fg_color, Color16::Transparent2);
       
-      for (auto& bs : m_player.blood_splats)
-        bs.update(sim_time_s);
-      for (auto& npc : all_npcs)
-        for (auto& bs : npc.blood_splats)
-          bs.update(sim_time_s);
-
       if (debug)
       {
-        sh.write_buffer(terrain2str(m_player.on_terrain), 5, 1, Color16::Black, Color16::White);
-        sh.write_buffer("Floor: " + std::to_string(m_player.curr_floor), 6, 1, Color16::Black, Color16::White);
+        auto terrain_str = terrain2str(snapshot.pc.on_terrain);
+        auto floor_str = "Floor: " + std::to_string(snapshot.curr_floor);
+        sh.write_buffer(terrain_str, 5, 1, Color16::Black, Color16::White);
+        sh.write_buffer(floor_str, 6, 1, Color16::Black, Color16::White);
+        f_set_drawn_rect(5, 1, 1, stlutils::sizeI(terrain_str));
+        f_set_drawn_rect(6, 1, 1, stlutils::sizeI(floor_str));
       }
       
       auto f_draw_swim_anim = [anim_ctr_swim, &sh, this](bool is_moving, int curr_floor,
@@ -1940,56 +2777,41 @@ namespace dung
       };
       
       // PC
-      if (m_player.is_spawned)
+      const auto& pc = snapshot.pc;
+      if (pc.is_spawned)
       {
-        sh.write_buffer(m_player.glyph, pc_scr_pos.r, pc_scr_pos.c, m_player.style);
+        sh.write_buffer(pc.glyph, pc_scr_pos.r, pc_scr_pos.c, pc.style);
+        f_set_drawn(pc_scr_pos, pc.style.bg_color);
         
-        if (is_wet(m_player.on_terrain))
-          f_draw_swim_anim(m_player.is_moving, m_player.curr_floor, m_player.pos, pc_scr_pos, m_player.los_r, m_player.los_c);
+        if (is_wet(pc.on_terrain))
+          f_draw_swim_anim(pc.is_moving, snapshot.curr_floor, pc.pos, pc_scr_pos, pc.los_r, pc.los_c);
             
-        m_player.draw(sh, sim_time_s);
+        if (snapshot.pc_has_fire_smoke)
+          m_player.draw_fire_smoke(sh, snapshot.pc_fire_smoke, sim_time_s);
       }
       
       // Items and NPCs
-      auto f_render_npc = [&](const auto& npc)
+      for (const auto& npc : snapshot.npcs)
       {
-        if (npc.curr_floor != m_player.curr_floor)
-          return;
-        if (!npc.visible)
-          return;
-        auto scr_pos = m_screen_helper->get_screen_pos(npc.pos);
-        sh.write_buffer(npc.glyph, scr_pos, npc.style);
-      };
-      
-      auto f_render_obj = [&](const auto& obj)
-      {
-        if (obj.curr_floor != m_player.curr_floor)
-          return;
-        if (!obj.visible)
-          return;
-        auto scr_pos = m_screen_helper->get_screen_pos(obj.pos);
-        auto fg_color = obj.style.fg_color;
-        if (obj.shade && obj.light)
-          fg_color = t8::shade_color(obj.style.fg_color,
-                                            t8::ShadeType::Dark);
-        sh.write_buffer(obj.glyph, scr_pos,
-          fg_color, obj.style.bg_color);
-      };
-      
-      for (const auto& npc : all_npcs)
-      {
-        if (npc.curr_floor != m_player.curr_floor)
+        // The death animations reach two textels away from the NPC.
+        if (!npc.debug && !scr_helper.is_on_screen(npc.pos, scr_size, 2))
           continue;
+        auto npc_scr_pos = scr_helper.get_screen_pos(npc.pos);
         //bool swimming = is_wet(npc.on_terrain) && npc.can_swim && !npc.can_fly;
         bool dead_on_liquid = npc.health <= 0 && is_wet(npc.on_terrain); //&& swimming;
-        if (!dead_on_liquid || sim_time_s - npc.death_time_s < 1.5f + (npc.can_fly ? 0.5f : 0.f))
-          f_render_npc(npc);
+        if (!dead_on_liquid || sim_time_s - npc.death_time_s < calc_npc_death_anim_duration(npc.can_fly))
+        {
+          if (npc.visible && scr_helper.is_on_screen(npc.pos, scr_size))
+          {
+            sh.write_buffer(npc.glyph, npc_scr_pos, npc.style);
+            f_set_drawn(npc_scr_pos, npc.style.bg_color);
+          }
+        }
         
         if (npc.visible && is_wet(npc.on_terrain))
         {
-          auto npc_scr_pos = m_screen_helper->get_screen_pos(npc.pos);
           if (npc.health > 0 && npc.can_swim && !npc.can_fly)
-            f_draw_swim_anim(npc.is_moving, npc.curr_floor, npc.pos, npc_scr_pos, npc.los_r, npc.los_c);
+            f_draw_swim_anim(npc.is_moving, snapshot.curr_floor, npc.pos, npc_scr_pos, npc.los_r, npc.los_c);
           else if (npc.health <= 0)
           {
             float time_delay = 0.f;
@@ -2012,7 +2834,7 @@ namespace dung
                     RC offs_pos { r_offs, c_offs };
                     RC npc_scr_offs_pos = npc_scr_pos + offs_pos;
                     RC npc_world_offs_pos = npc.pos + offs_pos;
-                    if (m_environment->is_inside_any_room(npc.curr_floor, npc_world_offs_pos))
+                    if (m_environment->is_inside_any_room(snapshot.curr_floor, npc_world_offs_pos))
                       sh.write_buffer("*", npc_scr_offs_pos.r, npc_scr_offs_pos.c, Color16::White, Color16::Transparent2);
                   }
               }
@@ -2027,7 +2849,7 @@ namespace dung
                   RC offs_pos { r_offs, c_offs };
                   RC npc_scr_offs_pos = npc_scr_pos + offs_pos;
                   RC npc_world_offs_pos = npc.pos + offs_pos;
-                  if (m_environment->is_inside_any_room(npc.curr_floor, npc_world_offs_pos))
+                  if (m_environment->is_inside_any_room(snapshot.curr_floor, npc_world_offs_pos))
                     sh.write_buffer("*", npc_scr_offs_pos.r, npc_scr_offs_pos.c, Color16::White, Color16::Transparent2);
                 }
             }
@@ -2036,79 +2858,67 @@ namespace dung
         
         if (npc.debug)
         {
-          auto scr_pos = m_screen_helper->get_screen_pos(npc.pos);
-          
           if (npc.vel_r < 0.f)
-            sh.write_buffer("^", scr_pos.r - 1, scr_pos.c, Color16::Black, Color16::White);
+            sh.write_buffer("^", npc_scr_pos.r - 1, npc_scr_pos.c, Color16::Black, Color16::White);
           else if (npc.vel_r > 0.f)
-            sh.write_buffer("v", scr_pos.r + 1, scr_pos.c, Color16::Black, Color16::White);
+            sh.write_buffer("v", npc_scr_pos.r + 1, npc_scr_pos.c, Color16::Black, Color16::White);
           
           if (npc.vel_c < 0.f)
-            sh.write_buffer("<", scr_pos.r, scr_pos.c - 1, Color16::Black, Color16::White);
+            sh.write_buffer("<", npc_scr_pos.r, npc_scr_pos.c - 1, Color16::Black, Color16::White);
           else if (npc.vel_c > 0.f)
-            sh.write_buffer(">", scr_pos.r, scr_pos.c + 1, Color16::Black, Color16::White);
+            sh.write_buffer(">", npc_scr_pos.r, npc_scr_pos.c + 1, Color16::Black, Color16::White);
           
-          if (npc.curr_room != nullptr)
+          if (npc.room_center.has_value())
           {
-            auto scr_pos_room = m_screen_helper->get_screen_pos(npc.curr_room->bb_leaf_room.center());
-            t8x::plot_line(sh, scr_pos, scr_pos_room,
+            auto scr_pos_room = scr_helper.get_screen_pos(npc.room_center.value());
+            t8x::plot_line(sh, npc_scr_pos, scr_pos_room,
                     "."_gs, Color16::White, Color16::Transparent2);
           }
-          if (npc.curr_corridor != nullptr)
+          if (npc.corridor_center.has_value())
           {
-            auto scr_pos_corr = m_screen_helper->get_screen_pos(npc.curr_corridor->bb.center());
-            t8x::plot_line(sh, scr_pos, scr_pos_corr,
+            auto scr_pos_corr = scr_helper.get_screen_pos(npc.corridor_center.value());
+            t8x::plot_line(sh, npc_scr_pos, scr_pos_corr,
                     "."_gs, Color16::White, Color16::Transparent2);
           }
         }
       }
       
-      for (auto* door : door_vec)
+      for (const auto& door : snapshot.doors)
       {
-        auto door_pos = door->pos;
-        auto door_scr_pos = m_screen_helper->get_screen_pos(door_pos);
-        std::string door_ch = "^";
-        if (door->is_door)
-        {
-          if (door->is_open)
-            door_ch = "L";
-          else if (door->is_locked)
-            door_ch = "G";
-          else
-            door_ch = "D";
-        }
-        sh.write_buffer(door_ch, door_scr_pos.r, door_scr_pos.c, Color16::Black, (use_fog_of_war && door->fog_of_war) ? Color16::Black : (door->light ? Color16::Yellow : Color16::DarkYellow));
+        if (!scr_helper.is_on_screen(door.pos, scr_size))
+          continue;
+        auto door_scr_pos = scr_helper.get_screen_pos(door.pos);
+        sh.write_buffer(door.ch, door_scr_pos.r, door_scr_pos.c, Color16::Black, door.bg_color);
+        f_set_drawn(door_scr_pos, door.bg_color);
       }
       
-      for (const auto* staircase : staircase_vec)
+      for (const auto& staircase : snapshot.staircases)
       {
-        auto staircase_scr_pos = m_screen_helper->get_screen_pos(staircase->pos);
-        sh.write_buffer("B", staircase_scr_pos.r, staircase_scr_pos.c, (use_fog_of_war && staircase->fog_of_war) ? Color16::Black : (staircase->light ? Color16::LightGray : Color16::DarkGray), Color16::Black);
+        if (!scr_helper.is_on_screen(staircase.pos, scr_size))
+          continue;
+        auto staircase_scr_pos = scr_helper.get_screen_pos(staircase.pos);
+        sh.write_buffer("B", staircase_scr_pos.r, staircase_scr_pos.c, staircase.fg_color, Color16::Black);
+        f_set_drawn(staircase_scr_pos, Color16::Black);
       }
       
-      for (const auto& key : all_keys)
-        f_render_obj(key);
-      
-      for (const auto& lamp : all_lamps)
-        f_render_obj(lamp);
-      
-      for (const auto& weapon : all_weapons)
-        f_render_obj(*weapon);
-        
-      for (const auto& potion : all_potions)
-        f_render_obj(potion);
-        
-      for (const auto& armour : all_armour)
-        f_render_obj(*armour);
+      for (const auto& item : snapshot.items)
+      {
+        if (!scr_helper.is_on_screen(item.pos, scr_size))
+          continue;
+        auto scr_pos = scr_helper.get_screen_pos(item.pos);
+        sh.write_buffer(item.glyph, scr_pos,
+          item.fg_color, item.bg_color);
+        f_set_drawn(scr_pos, item.bg_color);
+      }
         
       if (gore)
       {
-        auto f_draw_blood_splat = [&sh](int curr_floor, const RC& scr_pos, const BloodSplat& bs)
+        for (const auto& bs : snapshot.blood_splats)
         {
-          if (bs.curr_floor != curr_floor)
-            return;
+          if (!scr_helper.is_on_screen(bs.pos, scr_size))
+            continue;
           if (is_wet(bs.terrain) && !bs.alive)
-            return;
+            continue;
           std::string str = "";
           switch (bs.shape)
           {
@@ -2117,66 +2927,43 @@ namespace dung
             case 3: str = ":"; break;
             case 4: str = "~"; break;
           }
+          auto bs_scr_pos = scr_helper.get_screen_pos(bs.pos);
           auto style = t8::make_shaded_style(Color16::Red, bs.visible ? t8::ShadeType::Bright : t8::ShadeType::Dark);
-          sh.write_buffer(str, scr_pos.r, scr_pos.c, style);
-        };
-        for (const auto& bs : m_player.blood_splats)
-        {
-          auto bs_scr_pos = m_screen_helper->get_screen_pos(bs.pos);
-          f_draw_blood_splat(m_player.curr_floor, bs_scr_pos, bs);
-        }
-        for (const auto& npc : all_npcs)
-        {
-          for (const auto& bs : npc.blood_splats)
-          {
-            auto bs_scr_pos = m_screen_helper->get_screen_pos(bs.pos);
-            f_draw_blood_splat(m_player.curr_floor, bs_scr_pos, bs);
-          }
+          sh.write_buffer(str, bs_scr_pos.r, bs_scr_pos.c, style);
+          f_set_drawn(bs_scr_pos, style.bg_color);
         }
       }
       
-      m_environment->draw_environment(sh, real_time_s,
-                                      m_player.curr_floor, use_fog_of_war,
-                                      m_sun_dir, m_solar_motion,
-                                      m_t_solar_period, m_season,
-                                      m_use_per_room_lat_long_for_sun_dir,
-                                      m_screen_helper.get(),
+      m_environment->draw_environment(sh,
+                                      snapshot,
+                                      m_drawn_cells,
                                       debug);
                                       
       if (trigger_screenshot)
       {
-        auto screenshot = sh.export_screen_buffers();
-        
-        for (int r = 0; r < NR; ++r)
+        // #NOTE: Only one export at a time. The request is dropped while a previous one is being written.
+        if (!m_screenshot_export.valid())
         {
-          for (int c = 0; c < NC; ++c)
-          {
-            auto terrain = m_environment->get_terrain(m_player.curr_floor, m_screen_helper->get_world_pos({ r, c }));
-            screenshot.set_textel_material(r, c, static_cast<int>(terrain));
-          }
-        }
-        
-        std::string filepath = "screenshot_0.tx";
-        auto encoding = t8::TxGlyphEncoding::TryUnicodePreferredAndFallbackElseAsciiOnly;
-        // Expects just one listener.
-        broadcast([&filepath, &encoding](auto* l)
-          { l->on_screenshot_request(filepath, encoding); });
-        
-        if (t8::TextureFile::save(screenshot, filepath, true, encoding))
-        {
-          message_handler->add_message_multi_line(static_cast<float>(real_time_s),
-                                                  { t8::GlyphString::from_ascii("Successfully saved screenshot:"),
-                                                    t8::GlyphString::from_ascii("\"" + filepath + "\"!") },
-                                                  t8x::MessageHandlerLevel::Guide,
-                                                  3.f);
-        }
-        else
-        {
-          message_handler->add_message_multi_line(static_cast<float>(real_time_s),
-                                                  { t8::GlyphString::from_ascii("ERROR : Unable to save screenshot to file:"),
-                                                    t8::GlyphString::from_ascii("\"" + filepath + "\"!") },
-                                                  t8x::MessageHandlerLevel::Fatal,
-                                                  3.f);
+          auto screenshot = sh.export_screen_buffers();
+          std::vector<Terrain> terrain;
+          m_environment->fetch_terrain_rect(snapshot.curr_floor, scr_helper.get_world_pos({ 0, 0 }), { NR, NC }, terrain,
+                                            snapshot.texture_anim_ctr);
+          
+          std::string filepath = "screenshot_0.tx";
+          auto encoding = t8::TxGlyphEncoding::TryUnicodePreferredAndFallbackElseAsciiOnly;
+          // Expects just one listener.
+          broadcast([&filepath, &encoding](auto* l)
+            { l->on_screenshot_request(filepath, encoding); });
+          
+          m_screenshot_filepath = filepath;
+          m_screenshot_export = std::async(std::launch::async,
+            [screenshot = std::move(screenshot), terrain = std::move(terrain), filepath, encoding]() mutable
+            {
+              for (int r = 0; r < NR; ++r)
+                for (int c = 0; c < NC; ++c)
+                  screenshot.set_textel_material(r, c, static_cast<int>(terrain[r * NC + c]));
+              return t8::TextureFile::save(screenshot, filepath, true, encoding);
+            });
         }
         
         trigger_screenshot = false;
@@ -2308,6 +3095,10 @@ namespace dung
       
       TextIO::read_file(savegame_filename, lines);
       
+      // The NPC streams are derived from the seed of the saved game, whatever place_npcs() was given.
+      std::istringstream iss(lines[1]);
+      iss >> m_npc_rnd_seed;
+      
       for (auto it_line = lines.begin() + 2; it_line != lines.end(); ++it_line)
       {
         if (*it_line == "m_environment")
@@ -2330,8 +3121,13 @@ namespace dung
         }
         else if (*it_line == "all_npcs")
         {
-          for (auto& npc : all_npcs)
+          for (int npc_idx = 0; npc_idx < stlutils::sizeI(all_npcs); ++npc_idx)
+          {
+            // Older saves have no rng_state, in which case the NPC keeps a stream of its own.
+            auto& npc = all_npcs[npc_idx];
+            npc.seed_rng(m_npc_rnd_seed, npc_idx);
             it_line = npc.deserialize(it_line + 1, lines.end(), m_environment.get()); // code smell!!
+          }
         }
         
         else if (*it_line == "m_inventory")
@@ -2359,6 +3155,13 @@ namespace dung
         
         else if (sg::read_var(&it_line, SG_READ_VAR(use_fog_of_war)))
         {
+          rebuild_entity_index();
+          invalidate_visibilities();
+          // The NPCs were saved mid-simulation, so there is nothing for them to catch up on.
+          m_npc_sim_lod_floor = -1;
+          // The doors may have been saved in another state.
+          m_pursuit_field_floor = -1;
+          
           message_handler->add_message_multi_line(static_cast<float>(real_time_s),
                                                   { t8::GlyphString::from_ascii("Successfully loaded save-game:"),
                                                     t8::GlyphString::from_ascii("\"" + savegame_filename + "\"!") },
@@ -32,6 +32,8 @@ namespace dung
     virtual void on_load_game_request_pre(std::string& filepath) {}
     virtual void on_load_game_request_post(unsigned int rnd_seed) {}
     virtual void on_screenshot_request(std::string& filepath, t8::TxGlyphEncoding&) {}
+    // Called from DungGine::update() once the screenshot has been written (or failed to).
+    virtual void on_screenshot_saved(const std::string& filepath, bool success) {}
   };
 
 }
@@ -31,6 +31,9 @@ namespace dung
     std::vector<std::unique_ptr<BSPTree>> bsp_forest; // levels of bsp-trees.
     
     std::vector<std::unique_ptr<Staircase>> staircases; // staircases between levels (bsp-trees).
+    std::vector<std::vector<Staircase*>> floor_staircases; // non-owning, one vector per floor.
+    const std::vector<Staircase*> no_staircases;
+    int staircase_generation = 0; // Bumped whenever the staircases change.
     
     std::map<const BSPTree*, std::vector<BSPNode*>, PtrLess<BSPTree>> bsp_tree_rooms;
     
@@ -86,6 +89,8 @@ namespace dung
       //  bsp_tree->reset();
       bsp_forest.clear();
       staircases.clear();
+      floor_staircases.clear();
+      staircase_generation++;
       bsp_tree_rooms.clear();
     }
     
@@ -165,6 +170,14 @@ namespace dung
           }
         }
       }
+      
+      floor_staircases.assign(m_num_floors, {});
+      for (const auto& s : staircases)
+      {
+        stlutils::at_growing(floor_staircases, s->floor_A).emplace_back(s.get());
+        stlutils::at_growing(floor_staircases, s->floor_B).emplace_back(s.get());
+      }
+      staircase_generation++;
     }
     
     int num_floors() const
@@ -177,14 +190,16 @@ namespace dung
       return first_floor_is_surface_level;
     }
     
-    std::vector<Staircase*> fetch_staircases(int floor) const
+    int get_staircase_generation() const
     {
-      std::vector<Staircase*> staircases_raw;
-      staircases_raw.reserve(staircases.size());
-      for (const auto& s : staircases)
-        if (s->floor_A == floor || s->floor_B == floor)
-          staircases_raw.emplace_back(s.get());
-      return staircases_raw;
+      return staircase_generation;
+    }
+    
+    const std::vector<Staircase*>& fetch_staircases(int floor) const
+    {
+      if (stlutils::in_range(floor_staircases, floor))
+        return floor_staircases[floor];
+      return no_staircases;
     }
     
     void serialize(std::vector<std::string>& lines) const
@@ -0,0 +1,231 @@
+//
+//  EntityIndex.h
+//  DungGine
+//
+//  Created by Rasmus Anthin on 2026-10-17.
+//
+
+#pragma once
+#include "PlayerBase.h"
+#include "BSPTree.h"
+#include "Corridor.h"
+#include <Core/StlUtils.h>
+#include <array>
+#include <vector>
+
+
+namespace dung
+{
+
+  enum class EntityType { Key, Lamp, Weapon, Potion, Armour, NPC, NUM_ITEMS };
+
+  struct BloodSplatRef
+  {
+    int owner_idx = -1; // Index into all_npcs or -1 for the PC.
+    int splat_idx = -1;
+
+    bool operator==(const BloodSplatRef&) const = default;
+  };
+
+  // Indices into the all_keys, all_lamps, ... vectors of DungGine.
+  struct EntityBucket
+  {
+    std::vector<int> key_idcs;
+    std::vector<int> lamp_idcs;
+    std::vector<int> weapon_idcs;
+    std::vector<int> potion_idcs;
+    std::vector<int> armour_idcs;
+    std::vector<int> npc_idcs;
+    std::vector<BloodSplatRef> blood_splat_refs;
+
+    std::vector<int>& fetch_idcs(EntityType type)
+    {
+      switch (type)
+      {
+        case EntityType::Key: return key_idcs;
+        case EntityType::Lamp: return lamp_idcs;
+        case EntityType::Weapon: return weapon_idcs;
+        case EntityType::Potion: return potion_idcs;
+        case EntityType::Armour: return armour_idcs;
+        case EntityType::NPC:
+        case EntityType::NUM_ITEMS:
+          break;
+      }
+      return npc_idcs;
+    }
+
+    const std::vector<int>& fetch_idcs(EntityType type) const
+    {
+      return const_cast<EntityBucket*>(this)->fetch_idcs(type);
+    }
+  };
+
+  // Entities of each floor, filed under the room or the corridor they are inside of.
+  // Items that are carried by the PC or by an NPC are not indexed.
+  class EntityIndex
+  {
+    struct Placement
+    {
+      int floor = -1; // -1 : not indexed.
+      int room_id = -1;
+      int corridor_id = -1;
+
+      bool operator==(const Placement&) const = default;
+    };
+
+    // Indexed by BSPNode::id or Corridor::id, less the lowest id that has a bucket.
+    // The ids keep counting across the floors, so index 0 would be wasted on the floors above.
+    struct IdBuckets
+    {
+      int id_offs = 0; // Id of buckets[0].
+      std::vector<EntityBucket> buckets;
+      
+      EntityBucket& fetch_growing(int id)
+      {
+        if (buckets.empty())
+          id_offs = id;
+        else if (id < id_offs)
+        {
+          buckets.insert(buckets.begin(), id_offs - id, EntityBucket {});
+          id_offs = id;
+        }
+        return stlutils::at_growing(buckets, id - id_offs);
+      }
+    };
+    
+    struct FloorEntities
+    {
+      EntityBucket all;
+      IdBuckets room_buckets;
+      IdBuckets corridor_buckets;
+    };
+
+    std::vector<FloorEntities> m_floors;
+    const EntityBucket no_entities;
+    int m_generation = 0; // Bumped whenever an entity enters or leaves a bucket.
+    std::array<int, static_cast<size_t>(EntityType::NUM_ITEMS)> m_type_generations {};
+    std::array<std::vector<Placement>, static_cast<size_t>(EntityType::NUM_ITEMS)> m_placements;
+
+    // T is a DungObject or a PlayerBase.
+    template<typename T>
+    Placement calc_placement(const T& obj) const
+    {
+      Placement placement;
+      if (!stlutils::in_range(m_floors, obj.curr_floor))
+        return placement;
+      placement.floor = obj.curr_floor;
+      // #NOTE: curr_room and curr_corridor are both kept when passing through a door,
+      //   so prefer the corridor only when actually inside of it.
+      if (obj.curr_corridor != nullptr &&
+          (obj.curr_room == nullptr || obj.curr_corridor->is_inside_corridor(obj.pos)))
+        placement.corridor_id = obj.curr_corridor->id;
+      else if (obj.curr_room != nullptr)
+        placement.room_id = obj.curr_room->id;
+      return placement;
+    }
+
+    Placement& fetch_placement(EntityType type, int idx)
+    {
+      return stlutils::at_growing(m_placements[static_cast<size_t>(type)], idx);
+    }
+
+    template<typename Lambda>
+    void for_each_bucket(const Placement& placement, Lambda f)
+    {
+      if (placement.floor == -1)
+        return;
+      auto& floor_entities = m_floors[placement.floor];
+      f(floor_entities.all);
+      if (placement.room_id >= 0)
+        f(floor_entities.room_buckets.fetch_growing(placement.room_id));
+      if (placement.corridor_id >= 0)
+        f(floor_entities.corridor_buckets.fetch_growing(placement.corridor_id));
+    }
+
+    const EntityBucket& fetch_bucket(const IdBuckets& id_buckets, int id) const
+    {
+      if (!stlutils::in_range(id_buckets.buckets, id - id_buckets.id_offs))
+        return no_entities;
+      return id_buckets.buckets[id - id_buckets.id_offs];
+    }
+
+  public:
+    void reset(int num_floors)
+    {
+      m_floors.assign(num_floors, {});
+      for (auto& placements : m_placements)
+        placements.clear();
+      for (auto& type_generation : m_type_generations)
+        type_generation++;
+      m_generation++;
+    }
+
+    template<typename T>
+    void insert(EntityType type, int idx, const T& obj)
+    {
+      auto& placement = fetch_placement(type, idx);
+      if (placement.floor != -1)
+      {
+        std::cerr << "ERROR in EntityIndex::insert() : Entity is already indexed!\n";
+        return;
+      }
+      placement = calc_placement(obj);
+      for_each_bucket(placement, [type, idx](auto& bucket) { bucket.fetch_idcs(type).emplace_back(idx); });
+      m_type_generations[static_cast<size_t>(type)]++;
+      m_generation++;
+    }
+
+    void erase(EntityType type, int idx)
+    {
+      auto& placement = fetch_placement(type, idx);
+      for_each_bucket(placement, [type, idx](auto& bucket) { stlutils::erase(bucket.fetch_idcs(type), idx); });
+      placement = {};
+      m_type_generations[static_cast<size_t>(type)]++;
+      m_generation++;
+    }
+
+    // Cheap when the entity is still in the same room or corridor.
+    template<typename T>
+    void relocate(EntityType type, int idx, const T& obj)
+    {
+      if (fetch_placement(type, idx) == calc_placement(obj))
+        return;
+      erase(type, idx);
+      insert(type, idx, obj);
+    }
+
+    // Blood splats never leave the room or corridor they were spilled in.
+    void insert_blood_splat(int owner_idx, int splat_idx, const BloodSplat& bs)
+    {
+      auto placement = calc_placement(bs);
+      for_each_bucket(placement, [owner_idx, splat_idx](auto& bucket)
+        { bucket.blood_splat_refs.emplace_back(BloodSplatRef { owner_idx, splat_idx }); });
+      m_generation++;
+    }
+
+    int get_generation() const { return m_generation; }
+    int get_generation(EntityType type) const { return m_type_generations[static_cast<size_t>(type)]; }
+
+    const EntityBucket& fetch_floor_bucket(int floor) const
+    {
+      if (!stlutils::in_range(m_floors, floor))
+        return no_entities;
+      return m_floors[floor].all;
+    }
+
+    const EntityBucket& fetch_room_bucket(int floor, const BSPNode* room) const
+    {
+      if (room == nullptr || !stlutils::in_range(m_floors, floor))
+        return no_entities;
+      return fetch_bucket(m_floors[floor].room_buckets, room->id);
+    }
+
+    const EntityBucket& fetch_corridor_bucket(int floor, const Corridor* corridor) const
+    {
+      if (corridor == nullptr || !stlutils::in_range(m_floors, floor))
+        return no_entities;
+      return fetch_bucket(m_floors[floor].corridor_buckets, corridor->id);
+    }
+  };
+
+}
@@ -10,11 +10,16 @@
 #include "Dungeon.h"
 #include "RoomStyle.h"
 #include "Terrain.h"
+#include "TerrainGrid.h"
 #include "ScreenHelper.h"
 #include "Comparison.h"
+#include "BitPlane.h"
+#include "RenderSnapshot.h"
+#include "WorkerPool.h"
 #include <Termin8or/screen/ScreenHandler.h>
 #include <Termin8or/drawing/TextureFile.h>
 #include <optional>
+#include <numeric>
 
 
 namespace dung
@@ -31,14 +36,124 @@ namespace dung
     std::vector<std::string> texture_file_names_underground_shadow;
   };
 
+  // A textel as read back from a ScreenHandler.
+  struct EnvironmentTextel
+  {
+    t8::Glyph glyph;
+    Color fg_color;
+    Color bg_color;
+  };
+  
+  // A room or corridor drawn on its own, once with all of it lit and once with all of it dark.
+  // The static layer of the environment picks from the two, textel by textel, after the light field.
+  struct EnvironmentComposite
+  {
+    bool valid = false;
+    std::vector<EnvironmentTextel> lit; // Row-major, of the whole bounding box.
+    std::vector<EnvironmentTextel> dark;
+  };
+
+  // What draw_environment() needs of a room or a corridor, resolved once in style_dungeon().
+  template<typename T>
+  struct EnvironmentDrawItem
+  {
+    T* obj = nullptr;
+    const RoomStyle* style = nullptr;
+    Style fill_style;
+    Style fill_shadow_style;
+    t8::Glyph fill_glyph;
+    bool textured = false;
+    // Solar direction to shade the room with. Always Nadir underground.
+    // Only refreshed when the solar phase changes, see refresh_shadow_dirs().
+    SolarDirection shadow_dir = SolarDirection::Nadir;
+    // Rendered on demand, one per texture animation frame. Cleared when shadow_dir changes.
+    std::vector<EnvironmentComposite> composites;
+  };
+
   class Environment final
   {
     Dungeon* m_dungeon = nullptr;
     //std::vector<BSPNode*> m_leaves;
     
-    // One map per floor.
-    std::vector<std::map<BSPNode*, RoomStyle, PtrLess<BSPNode>>> m_room_styles;
-    std::vector<std::map<Corridor*, RoomStyle, PtrLess<Corridor>>> m_corridor_styles;
+    // One table per floor.
+    std::vector<RoomStyleTable<BSPNode>> m_room_styles;
+    std::vector<RoomStyleTable<Corridor>> m_corridor_styles;
+    
+    // One grid per floor. Baked at the end of style_dungeon().
+    std::vector<TerrainGrid> m_terrain_grids;
+    
+    // One list per floor. Baked at the end of style_dungeon().
+    // #NOTE: Points into m_room_styles and m_corridor_styles, so rebake whenever they are changed.
+    std::vector<std::vector<EnvironmentDrawItem<BSPNode>>> m_room_draw_items;
+    std::vector<std::vector<EnvironmentDrawItem<Corridor>>> m_corridor_draw_items;
+    
+    // What the shadow_dir of the draw items of each floor were last computed from.
+    struct ShadowDirsStamp
+    {
+      int solar_dirs_generation = -1;
+      SolarDirection sun_dir = SolarDirection::Nadir;
+      bool use_per_room_lat_long_for_sun_dir = false;
+      
+      bool operator==(const ShadowDirsStamp&) const = default;
+    };
+    std::vector<ShadowDirsStamp> m_shadow_dirs_stamps;
+    
+    // A room or corridor on screen, in the order that they are composed into the static layer.
+    struct LayerItem
+    {
+      const t8::Rectangle* bb = nullptr;
+      RC bb_scr_pos;
+      // Of the whole floor, as of the render snapshot.
+      const BitPlane* fog_of_war = nullptr; // nullptr : No fog of war.
+      const BitPlane* light = nullptr;
+      const EnvironmentComposite* composite = nullptr; // nullptr : Fully fogged.
+      char debug_ch = 0; // Written to textel (1, 1) of the box unless 0.
+    };
+    std::vector<LayerItem> m_layer_items;
+    
+    // The static layer is composed in horizontal bands of the screen, one band per task of m_band_workers.
+    int m_num_draw_bands = 1;
+    WorkerPool m_band_workers;
+    
+    // The light field of the composite being rendered, for the drawing functions of Termin8or.
+    bool_vector m_light_buffer;
+    
+    // texture_anim_ctr % m_num_anim_frames is the same frame of every texture animation
+    //   as texture_anim_ctr itself. Baked in bake_draw_items().
+    int m_num_anim_frames = 1;
+    
+    // The rooms and corridors on screen, fog of war included, as last composed by render_static_layer().
+    // Only composed again when something that it depends on changes (see StaticLayerStamp).
+    // Each frame it is written to the ScreenHandler in runs of textels of the same colours.
+    struct StaticLayerStamp
+    {
+      int floor = -1;
+      RC scr_world_pos { 0, 0 };
+      bool use_fog_of_war = false;
+      bool debug = false;
+      uint64_t fields_generation = 0;
+      ShadowDirsStamp shadow_dirs;
+      int texture_anim_frame = 0; // texture_anim_ctr % m_num_anim_frames.
+      
+      bool operator==(const StaticLayerStamp&) const = default;
+    };
+    std::optional<StaticLayerStamp> m_static_layer_stamp;
+    std::vector<EnvironmentTextel> m_static_layer; // Row-major, one textel per screen textel.
+    std::vector<char> m_static_layer_covered; // Per screen textel. 1 : Some room or corridor is drawn to it.
+    t8::GlyphString m_static_run;
+    
+    // The composites are rendered offscreen with the drawing functions of Termin8or.
+    // Type erased, since only draw_environment() knows the size of the screen.
+    struct OffscreenBase
+    {
+      virtual ~OffscreenBase() = default;
+    };
+    template<int NR, int NC, typename CharT>
+    struct Offscreen final : OffscreenBase
+    {
+      ScreenHandler<NR, NC, CharT> sh;
+    };
+    std::unique_ptr<OffscreenBase> m_offscreen;
     
     double dt_texture_anim_s = 0.1;
     double texture_anim_time_stamp = 0.;
@@ -49,6 +164,418 @@ namespace dung
     std::vector<Texture> texture_ug_shadow;
     Texture texture_empty;
     
+    static Terrain material_to_terrain(int mat)
+    {
+      // #FIXME: Canonize material idcs.
+      switch (mat)
+      {
+        case 0: return Terrain::Void;
+        case 1: return Terrain::Tile;
+        case 2: return Terrain::Water;
+        case 3: return Terrain::Sand;
+        case 4: return Terrain::Stone;
+        case 5: return Terrain::Masonry;
+        case 6: return Terrain::Brick;
+        case 7: return Terrain::Grass;
+        case 8: return Terrain::Shrub;
+        case 9: return Terrain::Tree;
+        case 10: return Terrain::Metal;
+        case 11: return Terrain::Wood;
+        case 12: return Terrain::Ice;
+        case 13: return Terrain::Mountain;
+        case 14: return Terrain::Lava;
+        case 15: return Terrain::Cave;
+        case 16: return Terrain::Swamp;
+        case 17: return Terrain::Poison;
+        case 18: return Terrain::Path;
+        case 19: return Terrain::Mine;
+        case 20: return Terrain::Gold;
+        case 21: return Terrain::Silver;
+        case 22: return Terrain::Gravel;
+        case 23: return Terrain::Bone;
+        case 24: return Terrain::Acid;
+        case 25: return Terrain::Column;
+        case 26: return Terrain::Tar;
+        case 27: return Terrain::Rope;
+        default: return Terrain::Default;
+      }
+    }
+    
+    static Terrain floor_type_to_terrain(FloorType floor_type)
+    {
+      switch (floor_type)
+      {
+        case FloorType::None: return Terrain::Default;
+        case FloorType::Sand: return Terrain::Sand;
+        case FloorType::Grass: return Terrain::Grass;
+        case FloorType::Stone: return Terrain::Stone;
+        case FloorType::Stone2: return Terrain::Stone;
+        case FloorType::Water: return Terrain::Water;
+        case FloorType::Wood: return Terrain::Wood;
+        default: return Terrain::Default;
+      }
+    }
+    
+    void bake_draw_items()
+    {
+      auto f_num_frames = [](const std::vector<Texture>& texture_vec)
+      {
+        return std::max(1, stlutils::sizeI(texture_vec));
+      };
+      m_num_anim_frames = std::lcm(std::lcm(f_num_frames(texture_sl_fill), f_num_frames(texture_sl_shadow)),
+                                   std::lcm(f_num_frames(texture_ug_fill), f_num_frames(texture_ug_shadow)));
+      
+      m_shadow_dirs_stamps.clear();
+      m_room_draw_items.clear();
+      m_room_draw_items.resize(m_room_styles.size());
+      for (int f_idx = 0; f_idx < stlutils::sizeI(m_room_styles); ++f_idx)
+      {
+        for (const auto& [room, room_style] : m_room_styles[f_idx])
+        {
+          auto& item = m_room_draw_items[f_idx].emplace_back();
+          item.obj = room;
+          item.style = &room_style;
+          item.fill_style = room_style.get_fill_style();
+          item.fill_shadow_style = t8::shade_style(item.fill_style, t8::ShadeType::Dark);
+          item.fill_glyph = room_style.get_fill_glyph();
+          item.textured = !(room_style.is_underground ? texture_ug_fill.empty() : texture_sl_fill.empty());
+        }
+      }
+      
+      m_corridor_draw_items.clear();
+      m_corridor_draw_items.resize(m_corridor_styles.size());
+      for (int f_idx = 0; f_idx < stlutils::sizeI(m_corridor_styles); ++f_idx)
+      {
+        for (const auto& [corr, corr_style] : m_corridor_styles[f_idx])
+        {
+          auto& item = m_corridor_draw_items[f_idx].emplace_back();
+          item.obj = corr;
+          item.style = &corr_style;
+          item.fill_style = corr_style.get_fill_style();
+          item.fill_shadow_style = t8::shade_style(item.fill_style, t8::ShadeType::Dark, true);
+          item.fill_glyph = corr_style.get_fill_glyph();
+        }
+      }
+    }
+    
+    void refresh_shadow_dirs(int floor, SolarDirection sun_dir, const SolarDirectionTable& solar_dirs,
+                             bool use_per_room_lat_long_for_sun_dir)
+    {
+      ShadowDirsStamp stamp { solar_dirs.get_generation(), sun_dir, use_per_room_lat_long_for_sun_dir };
+      auto& curr_stamp = stlutils::at_growing(m_shadow_dirs_stamps, floor);
+      if (curr_stamp == stamp)
+        return;
+      curr_stamp = stamp;
+      
+      auto f_refresh = [&](auto& item)
+      {
+        const auto& style = *item.style;
+        auto shadow_dir = sun_dir;
+        if (style.is_underground)
+          shadow_dir = SolarDirection::Nadir;
+        else if (use_per_room_lat_long_for_sun_dir)
+          shadow_dir = solar_dirs.get_solar_direction(style.latitude, style.longitude);
+        if (item.shadow_dir != shadow_dir)
+        {
+          item.shadow_dir = shadow_dir;
+          item.composites.clear();
+        }
+      };
+      if (stlutils::in_range(m_room_draw_items, floor))
+        for (auto& item : m_room_draw_items[floor])
+          f_refresh(item);
+      if (stlutils::in_range(m_corridor_draw_items, floor))
+        for (auto& item : m_corridor_draw_items[floor])
+          f_refresh(item);
+    }
+    
+    // #NOTE: The number of layers is chosen so that texture_anim_ctr % num_layers
+    //   maps onto the same animation frame as texture_anim_ctr % num_frames
+    //   for both the surface level and the underground textures.
+    void bake_terrain()
+    {
+      auto f_num_frames = [](const std::vector<Texture>& texture_vec)
+      {
+        return std::max(1, stlutils::sizeI(texture_vec));
+      };
+      const int num_layers = std::lcm(f_num_frames(texture_sl_fill), f_num_frames(texture_ug_fill));
+      
+      m_terrain_grids.clear();
+      m_terrain_grids.resize(m_dungeon->num_floors());
+      for (int f_idx = 0; f_idx < m_dungeon->num_floors(); ++f_idx)
+      {
+        auto* bsp_tree = m_dungeon->get_tree(f_idx);
+        if (bsp_tree == nullptr)
+          continue;
+        auto& grid = m_terrain_grids[f_idx];
+        grid.reset(bsp_tree->get_world_size(), num_layers);
+        
+        const auto* room_vec = m_dungeon->get_rooms(bsp_tree);
+        if (room_vec == nullptr || !stlutils::in_range(m_room_styles, f_idx))
+          continue;
+        for (auto* leaf : *room_vec)
+        {
+          const auto* room_style_ptr = m_room_styles[f_idx].find(leaf);
+          if (room_style_ptr == nullptr)
+            continue;
+          const auto& room_style = *room_style_ptr;
+          const auto& bb = leaf->bb_leaf_room;
+          const auto& fill_textures = room_style.is_underground ? texture_ug_fill : texture_sl_fill;
+          for (int l_idx = 0; l_idx < num_layers; ++l_idx)
+          {
+            const Texture* texture = fill_textures.empty() ? nullptr : &fill_textures[l_idx % fill_textures.size()];
+            for (int r = bb.top(); r <= bb.bottom(); ++r)
+            {
+              for (int c = bb.left(); c <= bb.right(); ++c)
+              {
+                RC pos { r, c };
+                if (!bb.is_inside_offs(pos, -1))
+                  continue;
+                if (texture != nullptr)
+                {
+                  auto local_pos = pos - bb.pos() - RC { 1, 1 };
+                  auto tex_pos = room_style.tex_pos + local_pos;
+                  grid.set_cell(l_idx, pos, material_to_terrain((*texture)(tex_pos).decode_raw_mat()));
+                }
+                else
+                  grid.set_cell(l_idx, pos, floor_type_to_terrain(room_style.floor_type));
+              }
+            }
+          }
+        }
+      }
+    }
+    
+    // Composes rows r_start .. r_end - 1 of the static layer from the layer items.
+    // An earlier item wins over a later one where they overlap, as when drawing them in order.
+    // Only writes to those rows of the layer, so disjoint bands of rows can be composed concurrently.
+    void compose_static_layer_rows(int r_start, int r_end, int num_cols)
+    {
+      const int c_num_bits = 64;
+      const EnvironmentTextel c_fog_textel { '.', Color16::Black, Color16::Black };
+      std::fill(m_static_layer_covered.begin() + r_start * num_cols,
+                m_static_layer_covered.begin() + r_end * num_cols, 0);
+      for (const auto& item : m_layer_items)
+      {
+        const auto& bb = *item.bb;
+        const auto& bb_scr_pos = item.bb_scr_pos;
+        int r_item_start = std::max(0, r_start - bb_scr_pos.r);
+        int r_item_end = std::min(bb.r_len, r_end - bb_scr_pos.r);
+        int c_item_start = std::max(0, -bb_scr_pos.c);
+        int c_item_end = std::min(bb.c_len, num_cols - bb_scr_pos.c);
+        for (int r = r_item_start; r < r_item_end; ++r)
+        {
+          int scr_idx = (bb_scr_pos.r + r) * num_cols + bb_scr_pos.c; // Of column 0 of the box.
+          auto f_set = [&](int c, const EnvironmentTextel& textel)
+          {
+            auto& covered = m_static_layer_covered[scr_idx + c];
+            if (covered == 0)
+            {
+              covered = 1;
+              m_static_layer[scr_idx + c] = textel;
+            }
+          };
+          
+          if (r == 1 && item.debug_ch != 0 && c_item_start <= 1 && 1 < c_item_end)
+            f_set(1, { item.debug_ch, Color16::White, Color16::Black });
+          
+          for (int c = c_item_start; c < c_item_end; c += c_num_bits)
+          {
+            int n = std::min(c_num_bits, c_item_end - c);
+            uint64_t fog_bits = ~uint64_t { 0 };
+            uint64_t light_bits = 0;
+            if (item.composite != nullptr)
+            {
+              fog_bits = item.fog_of_war != nullptr ? item.fog_of_war->get_bits(bb.r + r, bb.c + c, n) : 0;
+              light_bits = item.light->get_bits(bb.r + r, bb.c + c, n);
+            }
+            for (int b = 0; b < n; ++b)
+            {
+              if ((fog_bits >> b) & 1)
+                f_set(c + b, c_fog_textel);
+              else
+              {
+                const auto& textels = (light_bits >> b) & 1 ? item.composite->lit : item.composite->dark;
+                f_set(c + b, textels[r * bb.c_len + c + b]);
+              }
+            }
+          }
+        }
+      }
+    }
+    
+    template<int NR, int NC, typename CharT>
+    ScreenHandler<NR, NC, CharT>& fetch_offscreen()
+    {
+      auto* offscreen = dynamic_cast<Offscreen<NR, NC, CharT>*>(m_offscreen.get());
+      if (offscreen == nullptr)
+      {
+        auto new_offscreen = std::make_unique<Offscreen<NR, NC, CharT>>();
+        offscreen = new_offscreen.get();
+        m_offscreen = std::move(new_offscreen);
+      }
+      return offscreen->sh;
+    }
+    
+    // Renders the room or corridor, lit and dark, for frame anim_ctr of the texture animation.
+    // Boxes larger than the screen are rendered in tiles of the size of the screen.
+    template<int NR, int NC, typename CharT, typename T>
+    const EnvironmentComposite& fetch_composite(EnvironmentDrawItem<T>& item, const t8::Rectangle& bb,
+                                                unsigned short anim_ctr)
+    {
+      const int num_frames = item.textured ? m_num_anim_frames : 1;
+      if (stlutils::sizeI(item.composites) != num_frames)
+        item.composites.assign(num_frames, {});
+      auto& composite = item.composites[anim_ctr % num_frames];
+      if (composite.valid)
+        return composite;
+      
+      const auto& style = *item.style;
+      const auto& texture_fill = *fetch_curr_fill_texture(style, anim_ctr).value_or(&texture_empty);
+      const auto& texture_shadow = *fetch_curr_shadow_texture(style, anim_ctr).value_or(&texture_empty);
+      auto& sh = fetch_offscreen<NR, NC, CharT>();
+      const auto area = static_cast<size_t>(bb.r_len) * bb.c_len;
+      
+      for (bool lit : { true, false })
+      {
+        auto& textels = lit ? composite.lit : composite.dark;
+        textels.resize(area);
+        m_light_buffer.resize(area);
+        for (size_t idx = 0; idx < area; ++idx)
+          m_light_buffer[idx] = lit;
+        
+        for (int tile_r = 0; tile_r < bb.r_len; tile_r += NR)
+        {
+          for (int tile_c = 0; tile_c < bb.c_len; tile_c += NC)
+          {
+            sh.clear();
+            t8x::draw_box_outline(sh,
+                                  -tile_r, -tile_c, bb.r_len, bb.c_len,
+                                  style.wall_type,
+                                  style.wall_style,
+                                  m_light_buffer);
+            if (!item.textured)
+            {
+              t8x::draw_box(sh,
+                            -tile_r, -tile_c, bb.r_len, bb.c_len,
+                            item.fill_style,
+                            item.fill_glyph,
+                            item.shadow_dir,
+                            item.fill_shadow_style,
+                            item.fill_glyph,
+                            m_light_buffer);
+            }
+            else
+            {
+              t8x::draw_box_textured(sh,
+                                     -tile_r, -tile_c, bb.r_len, bb.c_len,
+                                     item.shadow_dir,
+                                     texture_fill,
+                                     texture_shadow,
+                                     m_light_buffer,
+                                     style.is_underground,
+                                     style.tex_pos);
+            }
+            
+            auto screen_buffers = sh.export_screen_buffers();
+            const int r_end = std::min(tile_r + NR, bb.r_len);
+            const int c_end = std::min(tile_c + NC, bb.c_len);
+            for (int r = tile_r; r < r_end; ++r)
+            {
+              for (int c = tile_c; c < c_end; ++c)
+              {
+                const auto& textel = screen_buffers(RC { r - tile_r, c - tile_c });
+                textels[r * bb.c_len + c] = { textel.glyph, textel.fg_color, textel.bg_color };
+              }
+            }
+          }
+        }
+      }
+      composite.valid = true;
+      return composite;
+    }
+    
+    // Composes the rooms and corridors of the floor that are on screen, fog of war included,
+    //   into m_static_layer.
+    template<int NR, int NC, typename CharT>
+    void render_static_layer(const RenderSnapshot& snapshot, bool debug)
+    {
+      const RC scr_size { NR, NC };
+      const int curr_floor = snapshot.curr_floor;
+      const bool use_fog_of_war = snapshot.use_fog_of_war;
+      const auto* screen_helper = &snapshot.screen_helper;
+      
+      m_layer_items.clear();
+      auto f_add_layer_items = [&](auto& draw_items, const std::vector<char>& fully_fogged, auto f_bb, bool is_room)
+      {
+        const int num_items = stlutils::sizeI(draw_items);
+        for (int item_idx = 0; item_idx < num_items; ++item_idx)
+        {
+          auto& item = draw_items[item_idx];
+          const auto& bb = f_bb(item.obj);
+          if (!screen_helper->overlaps_screen(bb, scr_size))
+            continue;
+          auto& layer_item = m_layer_items.emplace_back();
+          layer_item.bb = &bb;
+          layer_item.bb_scr_pos = screen_helper->get_screen_pos(bb.pos());
+          layer_item.light = &snapshot.light;
+          if (use_fog_of_war)
+            layer_item.fog_of_war = &snapshot.fog_of_war;
+          // Nothing of a fully fogged room would make it to the screen anyway.
+          bool is_fully_fogged = stlutils::in_range(fully_fogged, item_idx) && fully_fogged[item_idx] != 0;
+          if (!use_fog_of_war || !is_fully_fogged)
+            layer_item.composite = &fetch_composite<NR, NC, CharT>(item, bb, snapshot.texture_anim_ctr);
+          if (debug && is_room)
+            layer_item.debug_ch = item.style->is_underground ? '1' : '0';
+        }
+      };
+      if (stlutils::in_range(m_room_draw_items, curr_floor))
+        f_add_layer_items(m_room_draw_items[curr_floor], snapshot.room_fully_fogged, [](const BSPNode* room) -> const auto& { return room->bb_leaf_room; }, true);
+      if (stlutils::in_range(m_corridor_draw_items, curr_floor))
+        f_add_layer_items(m_corridor_draw_items[curr_floor], snapshot.corridor_fully_fogged, [](const Corridor* corr) -> const auto& { return corr->bb; }, false);
+      
+      m_static_layer.resize(NR * NC);
+      m_static_layer_covered.resize(NR * NC);
+      const int num_bands = std::min(m_num_draw_bands, NR);
+      m_band_workers.parallel_for(num_bands, [&](int band_idx)
+      {
+        compose_static_layer_rows(band_idx * NR / num_bands, (band_idx + 1) * NR / num_bands, NC);
+      });
+    }
+    
+    // Runs of textels of the same colours are written in one go.
+    // Textels that already hold an opaque textel (see drawn_cells) are skipped.
+    template<int NR, int NC, typename CharT>
+    void write_static_layer(ScreenHandler<NR, NC, CharT>& sh, const BitPlane& drawn_cells)
+    {
+      for (int r = 0; r < NR; ++r)
+      {
+        auto f_is_writable = [&](int c)
+        {
+          return m_static_layer_covered[r * NC + c] != 0 && !drawn_cells.get(r, c);
+        };
+        const auto* row = &m_static_layer[r * NC];
+        int c = 0;
+        while (c < NC)
+        {
+          if (!f_is_writable(c))
+          {
+            ++c;
+            continue;
+          }
+          const auto& textel = row[c];
+          int c_end = c + 1;
+          while (c_end < NC && f_is_writable(c_end)
+                 && row[c_end].fg_color == textel.fg_color && row[c_end].bg_color == textel.bg_color)
+            ++c_end;
+          m_static_run = t8::GlyphString::from_ascii(std::string(c_end - c, ' '));
+          for (int c_idx = c; c_idx < c_end; ++c_idx)
+            m_static_run[c_idx - c] = row[c_idx].glyph;
+          sh.write_buffer(m_static_run, r, c, textel.fg_color, textel.bg_color);
+          c = c_end;
+        }
+      }
+    }
     
   public:
     Environment() = default;
@@ -80,6 +607,11 @@ namespace dung
       m_dungeon = &dungeon;
       m_room_styles.clear();
       m_corridor_styles.clear();
+      m_terrain_grids.clear();
+      m_room_draw_items.clear();
+      m_corridor_draw_items.clear();
+      m_shadow_dirs_stamps.clear();
+      m_static_layer_stamp.reset();
     }
     
     void style_dungeon(Latitude latitude_0, Longitude longitude_0,
@@ -132,7 +664,7 @@ namespace dung
           
             f_calc_lat_long(room_style, leaf->bb_leaf_room);
           
-            stlutils::at_growing(m_room_styles, f_idx)[leaf] = room_style;
+            stlutils::at_growing(m_room_styles, f_idx).set(leaf, room_style);
           }
         }
         
@@ -147,9 +679,12 @@ namespace dung
           
           f_calc_lat_long(room_style, cp.second->bb);
           
-          stlutils::at_growing(m_corridor_styles, f_idx)[cp.second] = room_style;
+          stlutils::at_growing(m_corridor_styles, f_idx).set(cp.second, room_style);
         }
       }
+      
+      bake_terrain();
+      bake_draw_items();
     }
     
     const Dungeon* get_dungeon() const
@@ -178,19 +713,19 @@ namespace dung
       return bsp_tree->get_world_size();
     }
     
-    std::map<std::pair<BSPNode*, BSPNode*>, Corridor*, PtrPairLess<BSPNode>> get_room_corridor_map(int floor) const
+    const std::map<std::pair<BSPNode*, BSPNode*>, Corridor*, PtrPairLess<BSPNode>>& get_room_corridor_map(int floor) const
     {
       auto* bsp_tree = m_dungeon->get_tree(floor);
       return bsp_tree->get_room_corridor_map();
     }
     
-    std::vector<Door*> fetch_doors(int floor) const
+    const std::vector<Door*>& fetch_doors(int floor) const
     {
       auto* bsp_tree = m_dungeon->get_tree(floor);
       return bsp_tree->fetch_doors();
     }
     
-    std::vector<Staircase*> fetch_staircases(int floor) const
+    const std::vector<Staircase*>& fetch_staircases(int floor) const
     {
       return m_dungeon->fetch_staircases(floor);
     }
@@ -205,160 +740,109 @@ namespace dung
     // #NOTE: Only for unwalled area!
     bool is_inside_any_room(BSPTree* bsp_tree, const RC& pos, BSPNode** room_node = nullptr) const
     {
-      const auto* room_vec = m_dungeon->get_rooms(bsp_tree);
-      if (room_vec == nullptr)
+      if (bsp_tree == nullptr)
         return false;
-      for (auto* leaf : *room_vec)
-        if (leaf->bb_leaf_room.is_inside_offs(pos, -1))
-        {
-          utils::try_set(room_node, leaf);
-          return true;
-        }
-      return false;
+      auto* leaf = bsp_tree->find_leaf(pos);
+      if (!leaf->bb_leaf_room.is_inside_offs(pos, -1))
+        return false;
+      utils::try_set(room_node, leaf);
+      return true;
     }
     
     bool is_underground(int floor, BSPNode* room) const
     {
-      if (!stlutils::in_range(m_room_styles, floor))
+      const auto* room_style = find_room_style(floor, room);
+      if (room_style == nullptr)
         return true; // better be invisible.
-      if (room == nullptr)
-        return true; // better be invisible.
-      auto it = m_room_styles[floor].find(room);
-      if (it != m_room_styles[floor].end())
-        return it->second.is_underground;
-      return true;
+      return room_style->is_underground;
     }
     
     bool is_underground(int floor, Corridor* corr) const
     {
-      if (!stlutils::in_range(m_corridor_styles, floor))
-        return true; // better be invisible.
-      if (corr == nullptr)
+      const auto* corr_style = find_corridor_style(floor, corr);
+      if (corr_style == nullptr)
         return true; // better be invisible.
-      auto it = m_corridor_styles[floor].find(corr);
-      if (it != m_corridor_styles[floor].end())
-        return it->second.is_underground;
-      return true;
+      return corr_style->is_underground;
     }
     
-    std::optional<RoomStyle> find_room_style(int floor, BSPNode* room) const
+    const RoomStyle* find_room_style(int floor, const BSPNode* room) const
     {
       if (!stlutils::in_range(m_room_styles, floor))
-        return std::nullopt;
-      if (room == nullptr)
-        return std::nullopt;
-      auto itr = m_room_styles[floor].find(room);
-      if (itr != m_room_styles[floor].end())
-        return itr->second;
-      return std::nullopt;
+        return nullptr;
+      return m_room_styles[floor].find(room);
     }
     
-    std::optional<RoomStyle> find_corridor_style(int floor, Corridor* corridor) const
+    const RoomStyle* find_corridor_style(int floor, const Corridor* corridor) const
     {
       if (!stlutils::in_range(m_corridor_styles, floor))
-        return std::nullopt;
-      if (corridor == nullptr)
-        return std::nullopt;
-      auto itc = m_corridor_styles[floor].find(corridor);
-      if (itc != m_corridor_styles[floor].end())
-        return itc->second;
-      return std::nullopt;
+        return nullptr;
+      return m_corridor_styles[floor].find(corridor);
     }
     
-    std::optional<const Texture*> fetch_texture(const auto& texture_vector) const
+    std::optional<const Texture*> fetch_texture(const auto& texture_vector, unsigned short anim_ctr) const
     {
       if (texture_vector.empty())
         return std::nullopt; //texture_empty;
-      return &texture_vector[texture_anim_ctr % texture_vector.size()];
+      return &texture_vector[anim_ctr % texture_vector.size()];
     };
     
-    std::optional<const Texture*> fetch_curr_fill_texture(const RoomStyle& room_style) const
+    std::optional<const Texture*> fetch_texture(const auto& texture_vector) const
+    {
+      return fetch_texture(texture_vector, texture_anim_ctr);
+    };
+    
+    std::optional<const Texture*> fetch_curr_fill_texture(const RoomStyle& room_style, unsigned short anim_ctr) const
     {
       auto texture_fill = room_style.is_underground ?
-        fetch_texture(texture_ug_fill) : fetch_texture(texture_sl_fill);
+        fetch_texture(texture_ug_fill, anim_ctr) : fetch_texture(texture_sl_fill, anim_ctr);
       return texture_fill;
     }
     
-    std::optional<const Texture*> fetch_curr_shadow_texture(const RoomStyle& room_style) const
+    std::optional<const Texture*> fetch_curr_fill_texture(const RoomStyle& room_style) const
+    {
+      return fetch_curr_fill_texture(room_style, texture_anim_ctr);
+    }
+    
+    std::optional<const Texture*> fetch_curr_shadow_texture(const RoomStyle& room_style, unsigned short anim_ctr) const
     {
       auto texture_shadow = room_style.is_underground ?
-      fetch_texture(texture_ug_shadow) : fetch_texture(texture_sl_shadow);
+      fetch_texture(texture_ug_shadow, anim_ctr) : fetch_texture(texture_sl_shadow, anim_ctr);
       return texture_shadow;
     }
     
+    std::optional<const Texture*> fetch_curr_shadow_texture(const RoomStyle& room_style) const
+    {
+      return fetch_curr_shadow_texture(room_style, texture_anim_ctr);
+    }
+    
+    TerrainCell get_terrain_cell(int floor, const RC& pos) const
+    {
+      if (!stlutils::in_range(m_terrain_grids, floor))
+        return {};
+      return m_terrain_grids[floor].fetch_cell(texture_anim_ctr, pos);
+    }
+    
     Terrain get_terrain(int floor, const RC& pos) const
     {
-      auto* bsp_tree = m_dungeon->get_tree(floor);
-      if (bsp_tree == nullptr)
-        return Terrain::Default;
-      BSPNode* room = nullptr;
-      if (!is_inside_any_room(bsp_tree, pos, &room))
-        return Terrain::Default;
-      const auto& bb = room->bb_leaf_room;
-      if (bb.is_inside_offs(pos, -1))
+      return get_terrain_cell(floor, pos).get_terrain();
+    }
+    
+    // Batched get_terrain() of a rectangle of the world, e.g. the part that is on screen.
+    void fetch_terrain_rect(int floor, const RC& world_pos, const RC& size, std::vector<Terrain>& terrain) const
+    {
+      fetch_terrain_rect(floor, world_pos, size, terrain, texture_anim_ctr);
+    }
+    
+    // As of frame anim_ctr of the texture animation, e.g. the one of a render snapshot.
+    void fetch_terrain_rect(int floor, const RC& world_pos, const RC& size, std::vector<Terrain>& terrain,
+                            unsigned short anim_ctr) const
+    {
+      if (!stlutils::in_range(m_terrain_grids, floor))
       {
-        if (!stlutils::in_range(m_room_styles, floor))
-          return Terrain::Default;
-        auto its = m_room_styles[floor].find(room);
-        if (its == m_room_styles[floor].end())
-          return Terrain::Default;
-        const auto& room_style = its->second;
-        auto local_pos = pos - bb.pos() - RC { 1, 1 };
-        auto tex_pos = room_style.tex_pos + local_pos;
-        auto texture = fetch_curr_fill_texture(room_style);
-        if (texture.has_value())
-        {
-          int curr_mat = (*texture.value())(tex_pos).decode_raw_mat();
-          // #FIXME: Canonize material idcs.
-          switch (curr_mat)
-          {
-            case 0: return Terrain::Void;
-            case 1: return Terrain::Tile;
-            case 2: return Terrain::Water;
-            case 3: return Terrain::Sand;
-            case 4: return Terrain::Stone;
-            case 5: return Terrain::Masonry;
-            case 6: return Terrain::Brick;
-            case 7: return Terrain::Grass;
-            case 8: return Terrain::Shrub;
-            case 9: return Terrain::Tree;
-            case 10: return Terrain::Metal;
-            case 11: return Terrain::Wood;
-            case 12: return Terrain::Ice;
-            case 13: return Terrain::Mountain;
-            case 14: return Terrain::Lava;
-            case 15: return Terrain::Cave;
-            case 16: return Terrain::Swamp;
-            case 17: return Terrain::Poison;
-            case 18: return Terrain::Path;
-            case 19: return Terrain::Mine;
-            case 20: return Terrain::Gold;
-            case 21: return Terrain::Silver;
-            case 22: return Terrain::Gravel;
-            case 23: return Terrain::Bone;
-            case 24: return Terrain::Acid;
-            case 25: return Terrain::Column;
-            case 26: return Terrain::Tar;
-            case 27: return Terrain::Rope;
-            default: return Terrain::Default;
-          }
-        }
-        else
-        {
-          switch (room_style.floor_type)
-          {
-            case FloorType::None: return Terrain::Default;
-            case FloorType::Sand: return Terrain::Sand;
-            case FloorType::Grass: return Terrain::Grass;
-            case FloorType::Stone: return Terrain::Stone;
-            case FloorType::Stone2: return Terrain::Stone;
-            case FloorType::Water: return Terrain::Water;
-            case FloorType::Wood: return Terrain::Wood;
-            default: return Terrain::Default;
-          }
-        }
+        terrain.assign(static_cast<size_t>(std::max(0, size.r)) * std::max(0, size.c), TerrainCell {}.get_terrain());
+        return;
       }
-      return Terrain::Default;
+      m_terrain_grids[floor].fetch_terrain_rect(anim_ctr, world_pos, size, terrain);
     }
     
     Terrain get_terrain(int floor, int r, int c) const
@@ -368,131 +852,86 @@ namespace dung
     
     bool allow_move_to(int floor, int r, int c) const
     {
-      auto terrain = get_terrain(floor, RC { r, c });
+      return get_terrain_cell(floor, RC { r, c }).allow_move_to();
+    }
     
-      return dung::allow_move_to(terrain);
+    // Number of horizontal bands of the screen that the static layer is composed in.
+    // Each band beyond the first one gets a worker thread of its own.
+    void set_num_draw_bands(int num_bands)
+    {
+      num_bands = std::max(1, num_bands);
+      if (num_bands == m_num_draw_bands)
+        return;
+      m_num_draw_bands = num_bands;
+      m_band_workers.reset(num_bands - 1);
     }
     
-    template<int NR, int NC, typename CharT>
-    void draw_environment(ScreenHandler<NR, NC, CharT>& sh, double real_time_s,
-                          int curr_floor, bool use_fog_of_war,
-                          SolarDirection sun_dir, SolarMotionPatterns& solar_motion,
-                          float t_solar_period, Season season,
-                          bool use_per_room_lat_long_for_sun_dir,
-                          ScreenHelper* screen_helper,
-                          bool debug)
+    // True if any of the textures has more than one frame.
+    bool has_texture_anim() const
+    {
+      return m_num_anim_frames > 1;
+    }
+    
+    // True if the next call to update_texture_anim() will step the texture animation.
+    bool is_texture_anim_due(double real_time_s) const
     {
-      auto shadow_type = sun_dir;
-      if (stlutils::in_range(m_room_styles, curr_floor))
+      if (!has_texture_anim())
+        return false;
+      return real_time_s - texture_anim_time_stamp > dt_texture_anim_s;
+    }
+    
+    // Steps the texture animation, which also steps the terrain of the animated textures.
+    void update_texture_anim(double real_time_s)
+    {
+      if (is_texture_anim_due(real_time_s))
       {
-        for (const auto& room_pair : m_room_styles[curr_floor])
-        {
-          auto* room = room_pair.first;
-          const auto& bb = room->bb_leaf_room;
-          const auto& room_style = room_pair.second;
-          auto bb_scr_pos = screen_helper->get_screen_pos(bb.pos());
-          if (use_per_room_lat_long_for_sun_dir)
-            shadow_type = solar_motion.get_solar_direction(room_style.latitude, room_style.longitude, season, t_solar_period);
-          
-          if (debug)
-          {
-            sh.write_buffer(std::to_string(room_style.is_underground), bb_scr_pos.r + 1, bb_scr_pos.c + 1, Color16::White, Color16::Black);
-          }
-          
-          // Fog of war
-          if (use_fog_of_war)
-          {
-            for (int r = 0; r < bb.r_len; ++r)
-            {
-              for (int c = 0; c < bb.c_len; ++c)
-              {
-                if (room->fog_of_war[r * bb.c_len + c])
-                  sh.write_buffer(".", bb_scr_pos.r + r, bb_scr_pos.c + c, Color16::Black, Color16::Black);
-              }
-            }
-          }
-          
-          t8x::draw_box_outline(sh,
-                                    bb_scr_pos.r, bb_scr_pos.c, bb.r_len, bb.c_len,
-                                    room_style.wall_type,
-                                    room_style.wall_style,
-                                    room->light);
-          
-          if (room_style.is_underground ? texture_ug_fill.empty() : texture_sl_fill.empty())
-          {
-            t8x::draw_box(sh,
-                              bb_scr_pos.r, bb_scr_pos.c, bb.r_len, bb.c_len,
-                              room_style.get_fill_style(),
-                              room_style.get_fill_glyph(),
-                              room_style.is_underground ? SolarDirection::Nadir : shadow_type,
-                              t8::shade_style(room_style.get_fill_style(), t8::ShadeType::Dark),
-                              room_style.get_fill_glyph(),
-                              room->light);
-          }
-          else
-          {
-            if (real_time_s - texture_anim_time_stamp > dt_texture_anim_s)
-            {
-              texture_anim_ctr++;
-              texture_anim_time_stamp = real_time_s;
-            }
-            
-            const auto& texture_fill = *(fetch_curr_fill_texture(room_style).value_or(&texture_empty));
-            const auto& texture_shadow = *(fetch_curr_shadow_texture(room_style).value_or(&texture_empty));
-            
-            t8x::draw_box_textured(sh,
-                                       bb_scr_pos.r, bb_scr_pos.c, bb.r_len, bb.c_len,
-                                       room_style.is_underground ? SolarDirection::Nadir : shadow_type,
-                                       texture_fill,
-                                       texture_shadow,
-                                       room->light,
-                                       room_style.is_underground,
-                                       room_style.tex_pos);
-          }
-        }
+        texture_anim_ctr++;
+        texture_anim_time_stamp = real_time_s;
       }
+    }
+    
+    unsigned short get_texture_anim_ctr() const { return texture_anim_ctr; }
+    
+    // One per room and corridor draw item of the floor, in the order that draw_environment() visits them.
+    // Nothing of a fully fogged room or corridor would make it to the screen.
+    void fetch_fully_fogged(int floor, std::vector<char>& rooms, std::vector<char>& corridors) const
+    {
+      rooms.clear();
+      corridors.clear();
+      if (stlutils::in_range(m_room_draw_items, floor))
+        for (const auto& item : m_room_draw_items[floor])
+          rooms.emplace_back(item.obj->fog_of_war.is_fully_fogged() ? 1 : 0);
+      if (stlutils::in_range(m_corridor_draw_items, floor))
+        for (const auto& item : m_corridor_draw_items[floor])
+          corridors.emplace_back(item.obj->fog_of_war.is_fully_fogged() ? 1 : 0);
+    }
+    
+    template<int NR, int NC, typename CharT>
+    void draw_environment(ScreenHandler<NR, NC, CharT>& sh,
+                          const RenderSnapshot& snapshot,
+                          const BitPlane& drawn_cells,
+                          bool debug)
+    {
+      const int curr_floor = snapshot.curr_floor;
       
-      shadow_type = sun_dir;
-      if (stlutils::in_range(m_corridor_styles, curr_floor))
+      refresh_shadow_dirs(curr_floor, snapshot.sun_dir, snapshot.solar_dirs,
+                          snapshot.use_per_room_lat_long_for_sun_dir);
+      
+      StaticLayerStamp stamp;
+      stamp.floor = curr_floor;
+      stamp.scr_world_pos = snapshot.screen_helper.get_world_pos({ 0, 0 });
+      stamp.use_fog_of_war = snapshot.use_fog_of_war;
+      stamp.debug = debug;
+      stamp.fields_generation = snapshot.fields_generation;
+      stamp.shadow_dirs = m_shadow_dirs_stamps[curr_floor];
+      stamp.texture_anim_frame = snapshot.texture_anim_ctr % m_num_anim_frames;
+      if (m_static_layer_stamp != stamp)
       {
-        for (const auto& corr_pair : m_corridor_styles[curr_floor])
-        {
-          auto* corr = corr_pair.first;
-          const auto& bb = corr->bb;
-          const auto& corr_style = corr_pair.second;
-          auto bb_scr_pos = screen_helper->get_screen_pos(bb.pos());
-          if (use_per_room_lat_long_for_sun_dir)
-            shadow_type = solar_motion.get_solar_direction(corr_style.latitude, corr_style.longitude, season, t_solar_period);
-          
-          // Fog of war
-          if (use_fog_of_war)
-          {
-            for (int r = 0; r < bb.r_len; ++r)
-            {
-              for (int c = 0; c < bb.c_len; ++c)
-              {
-                if (corr->fog_of_war[r * bb.c_len + c])
-                  sh.write_buffer(".", bb_scr_pos.r + r, bb_scr_pos.c + c, Color16::Black, Color16::Black);
-              }
-            }
-          }
-          
-          
-          t8x::draw_box_outline(sh,
-                                    bb_scr_pos.r, bb_scr_pos.c, bb.r_len, bb.c_len,
-                                    corr_style.wall_type,
-                                    corr_style.wall_style,
-                                    corr->light);
-          t8x::draw_box(sh,
-                            bb_scr_pos.r, bb_scr_pos.c, bb.r_len, bb.c_len,
-                            corr_style.get_fill_style(),
-                            corr_style.get_fill_glyph(),
-                            corr_style.is_underground ? SolarDirection::Nadir : shadow_type,
-                            t8::shade_style(corr_style.get_fill_style(), t8::ShadeType::Dark, true),
-                            corr_style.get_fill_glyph(),
-                            corr->light);
-        }
+        render_static_layer<NR, NC, CharT>(snapshot, debug);
+        m_static_layer_stamp = stamp;
       }
+      
+      write_static_layer(sh, drawn_cells);
     }
     
     BSPNode* find_room(int floor, int id) const
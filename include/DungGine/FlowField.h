@@ -0,0 +1,176 @@
+//
+//  FlowField.h
+//  DungGine
+//
+//  Created by Rasmus Anthin on 2026-10-17.
+//
+
+#pragma once
+#include "BitPlane.h"
+#include <Termin8or/geom/RC.h>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+
+namespace dung
+{
+  using RC = t8::RC;
+
+  // Number of steps from the walkable cells of a floor to a target cell,
+  //   found by a breadth-first search that stops at a given number of steps.
+  // Steps go to any of the eight neighbours, but diagonal steps may not cut a corner,
+  //   so that nothing squeezes diagonally through a doorway.
+  class FlowField
+  {
+    static constexpr uint16_t c_unreached = 0xFFFF;
+
+    RC m_size { 0, 0 };
+    BitPlane m_walkable;
+    bool m_baked = false;
+    std::vector<uint16_t> m_dist; // Row-major.
+    std::vector<int> m_reached; // Cell indices in search order. Doubles as the queue of the search.
+    std::optional<RC> m_target;
+
+    bool in_bounds(int r, int c) const
+    {
+      return 0 <= r && r < m_size.r && 0 <= c && c < m_size.c;
+    }
+
+    bool is_walkable(int r, int c) const
+    {
+      return in_bounds(r, c) && m_walkable.get(r, c);
+    }
+
+    bool can_step(const RC& pos, int dr, int dc) const
+    {
+      if (!is_walkable(pos.r + dr, pos.c + dc))
+        return false;
+      if (dr != 0 && dc != 0)
+        return is_walkable(pos.r + dr, pos.c) && is_walkable(pos.r, pos.c + dc);
+      return true;
+    }
+
+    int get_dist(const RC& pos) const
+    {
+      if (!in_bounds(pos.r, pos.c))
+        return c_unreached;
+      return m_dist[pos.r * m_size.c + pos.c];
+    }
+
+    // Orthogonal steps first, so that they win ties.
+    static constexpr int c_num_dirs = 8;
+    static constexpr int c_dir_r[c_num_dirs] { -1, 0, 0, 1, -1, -1, 1, 1 };
+    static constexpr int c_dir_c[c_num_dirs] { 0, -1, 1, 0, -1, 1, -1, 1 };
+
+  public:
+    // All cells start out as not walkable.
+    void reset(const RC& size)
+    {
+      m_size = size;
+      m_walkable.reset(size.r, size.c);
+      m_dist.assign(static_cast<size_t>(size.r) * size.c, c_unreached);
+      m_reached.clear();
+      m_target.reset();
+      m_baked = false;
+    }
+
+    // Takes over the walkable cells of other and forgets the last search.
+    // Keeps the buffers, so a scratch field can be reused for fields of other sizes.
+    void assign_walkable(const FlowField& other)
+    {
+      if (m_size != other.m_size)
+      {
+        m_size = other.m_size;
+        m_dist.assign(static_cast<size_t>(m_size.r) * m_size.c, c_unreached);
+      }
+      else
+        for (int idx : m_reached)
+          m_dist[idx] = c_unreached;
+      m_reached.clear();
+      m_walkable = other.m_walkable;
+      m_target.reset();
+      m_baked = other.m_baked;
+    }
+
+    void set_walkable(const RC& pos, bool walkable)
+    {
+      if (in_bounds(pos.r, pos.c))
+        m_walkable.set(pos.r, pos.c, walkable);
+    }
+
+    bool is_walkable(const RC& pos) const
+    {
+      return is_walkable(pos.r, pos.c);
+    }
+
+    // Set by the owner once all the static cells have been made walkable.
+    void set_baked() { m_baked = true; }
+    bool is_baked() const { return m_baked; }
+
+    // Only the cells that were reached by the previous search are cleared.
+    void compute(const RC& target, int max_dist)
+    {
+      for (int idx : m_reached)
+        m_dist[idx] = c_unreached;
+      m_reached.clear();
+      m_target = target;
+      if (!in_bounds(target.r, target.c))
+        return;
+
+      // The target itself need not be walkable, e.g. when the PC stands on an open door that is then closed.
+      int target_idx = target.r * m_size.c + target.c;
+      m_dist[target_idx] = 0;
+      m_reached.emplace_back(target_idx);
+      for (size_t head = 0; head < m_reached.size(); ++head)
+      {
+        int idx = m_reached[head];
+        auto dist = m_dist[idx];
+        if (dist >= max_dist)
+          continue;
+        RC pos { idx / m_size.c, idx % m_size.c };
+        for (int d_idx = 0; d_idx < c_num_dirs; ++d_idx)
+        {
+          if (!can_step(pos, c_dir_r[d_idx], c_dir_c[d_idx]))
+            continue;
+          int next_idx = idx + c_dir_r[d_idx] * m_size.c + c_dir_c[d_idx];
+          if (m_dist[next_idx] != c_unreached)
+            continue;
+          m_dist[next_idx] = static_cast<uint16_t>(dist + 1);
+          m_reached.emplace_back(next_idx);
+        }
+      }
+    }
+
+    const std::optional<RC>& get_target() const { return m_target; }
+
+    // Returns -1 if pos was not reached by the last search.
+    int get_distance(const RC& pos) const
+    {
+      int dist = get_dist(pos);
+      return dist == c_unreached ? -1 : dist;
+    }
+
+    // Unit step (each component in {-1, 0, 1}) from pos towards the target, along the shortest path.
+    // Returns std::nullopt at the target and for cells that were not reached.
+    std::optional<RC> get_step_dir(const RC& pos) const
+    {
+      int dist = get_dist(pos);
+      if (dist == c_unreached || dist == 0)
+        return std::nullopt;
+      std::optional<RC> best_dir;
+      for (int d_idx = 0; d_idx < c_num_dirs; ++d_idx)
+      {
+        RC dir { c_dir_r[d_idx], c_dir_c[d_idx] };
+        int next_dist = get_dist(pos + dir);
+        if (next_dist < dist && (next_dist == 0 || can_step(pos, dir.r, dir.c)))
+        {
+          dist = next_dist;
+          best_dir = dir;
+        }
+      }
+      return best_dir;
+    }
+  };
+
+}
@@ -8,6 +8,7 @@
 #pragma once
 #include "Items.h"
 #include "SaveGame.h"
+#include "RenderSnapshot.h"
 #include <Termin8or/screen/ScreenHandler.h>
 #include <Termin8or/drawing/Drawing.h>
 #include <Termin8or/geom/Rectangle.h>
@@ -644,21 +645,43 @@ namespace dung
       };
     }
       
+    // The lines of the inventory as they would be drawn now.
+    void fetch_lines(std::vector<InventoryLineRenderState>& lines) const
+    {
+      lines.clear();
+      int num_lines = size();
+      for (int r = 0; r < num_lines; ++r)
+      {
+        auto item = get_item(r);
+        lines.push_back({ item.text, item.level, item.selected, item.hilited });
+      }
+    }
+    
     template<int NR, int NC, typename CharT>
     void draw(ScreenHandler<NR, NC, CharT>& sh) const
+    {
+      std::vector<InventoryLineRenderState> lines;
+      fetch_lines(lines);
+      draw(sh, lines);
+    }
+    
+    // Draws lines from fetch_lines(), which may have been fetched earlier.
+    template<int NR, int NC, typename CharT>
+    void draw(ScreenHandler<NR, NC, CharT>& sh, const std::vector<InventoryLineRenderState>& lines) const
     {
       sh.write_buffer(str::adjust_str("Inventory", str::Adjustment::Center, m_bb.c_len), m_bb.top() + rb0_title, m_bb.left(), Color16::White, Color16::Transparent2);
       
-      int num_lines = size();
+      int num_lines = stlutils::sizeI(lines);
       
-      int hilite_idx = std::max(0, find_hilited_index());
+      auto it_hilited = stlutils::find_if(lines, [](const auto& line) { return line.hilited; });
+      int hilite_idx = it_hilited != lines.end() ? static_cast<int>(it_hilited - lines.begin()) : 0;
       
       int r_offs = std::max(0, hilite_idx - (m_bb.r_len - rb0_items - 2));
         
       for (int r = 0; r < num_lines; ++r)
       {
-        auto item = get_item(r);
-        auto text = item.text;
+        const auto& item = lines[r];
+        const auto& text = item.text;
         t8::Style style { Color16::Default, Color16::Transparent2 };
         int c_offs = item.level*2;
         switch (item.level)
@@ -10,17 +10,56 @@
 #include "Inventory.h"
 #include "PC.h"
 #include "Items.h"
+#include "EntityIndex.h"
 #include <Termin8or/ui/MessageHandler.h>
 #include <Termin8or/ui/widget/TextBoxDebug.h>
 #include <Core/Utils.h>
 #include <functional>
+#include <optional>
 
 using namespace std::string_literals;
 
 
 namespace dung
 {
-  using MessageHandler = t8x::MessageHandler<t8::GlyphString>;
+  // Remembers when the latest message was posted, so that the engine knows
+  //   for how long the message box can still change by itself.
+  class MessageHandler : public t8x::MessageHandler<t8::GlyphString>
+  {
+    using Base = t8x::MessageHandler<t8::GlyphString>;
+    
+    float m_last_message_time_s = 0.f;
+    bool m_has_posted = false;
+    
+    void on_post(float time_s)
+    {
+      m_last_message_time_s = time_s;
+      m_has_posted = true;
+    }
+    
+  public:
+    template<typename... Args>
+    void add_message(float time_s, Args&&... args)
+    {
+      on_post(time_s);
+      Base::add_message(time_s, std::forward<Args>(args)...);
+    }
+    
+    template<typename... Args>
+    void add_message_multi_line(float time_s, const std::vector<t8::GlyphString>& msg_lines, Args&&... args)
+    {
+      on_post(time_s);
+      Base::add_message_multi_line(time_s, msg_lines, std::forward<Args>(args)...);
+    }
+    
+    // Time of the latest message posted, if any.
+    std::optional<float> get_last_message_time() const
+    {
+      if (!m_has_posted)
+        return std::nullopt;
+      return m_last_message_time_s;
+    }
+  };
   
 
   class Keyboard
@@ -43,6 +82,8 @@ namespace dung
     
     std::vector<NPC>& m_all_npcs;
     
+    EntityIndex& m_entity_index;
+    
     bool& m_trigger_game_save;
     bool& m_trigger_game_load;
     bool& m_trigger_screenshot;
@@ -50,6 +91,9 @@ namespace dung
     t8x::TextBoxDebug& m_tbd;
     bool& m_debug;
     
+    int m_num_door_state_changes = 0;
+    int m_num_handled_keys = 0;
+    
     void drop_item(Item* obj, const RC& curr_pos)
     {
       obj->picked_up = false;
@@ -69,6 +113,22 @@ namespace dung
       }
     }
     
+    // Indices of the items lying on pos in the room and corridor of the PC.
+    template<typename Elem>
+    std::vector<int> find_item_idcs_at(EntityType entity_type, const std::vector<Elem>& all_type_items, const RC& pos) const
+    {
+      std::vector<int> idcs;
+      auto f_collect = [&](const EntityBucket& bucket)
+      {
+        for (int idx : bucket.fetch_idcs(entity_type))
+          if (utils::get_raw_ptr(all_type_items[idx])->pos == pos)
+            idcs.emplace_back(idx);
+      };
+      f_collect(m_entity_index.fetch_room_bucket(m_player.curr_floor, m_player.curr_room));
+      f_collect(m_entity_index.fetch_corridor_bucket(m_player.curr_floor, m_player.curr_corridor));
+      return idcs;
+    }
+    
     template<typename Elem,
              typename LambdaItemType,
              typename LambdaID,
@@ -77,6 +137,7 @@ namespace dung
                             std::string& msg,
                             const std::string& group_title,
                             int subgroup_idx,
+                            EntityType entity_type,
                             LambdaItemType&& pred_item_type,
                             const RC& curr_pos,
                             bool dropped_over_liquid,
@@ -98,6 +159,7 @@ namespace dung
                                            [item](const auto& o) { return utils::get_raw_ptr(o) == item; });
           msg += pred_item_type(item) + ":" + std::to_string(pred_get_id(item, idx)) + "!";
           drop_item(item, curr_pos);
+          m_entity_index.insert(entity_type, idx, *item);
           stlutils::erase(held_type_item_idcs, idx);
           inv_subgroup->remove_item(item);
           if (dropped_over_liquid)
@@ -117,6 +179,7 @@ namespace dung
              std::vector<Potion>& all_potions,
              std::vector<std::unique_ptr<Armour>>& all_armour,
              std::vector<NPC>& all_npcs,
+             EntityIndex& entity_index,
              bool& trigger_game_save,
              bool& trigger_game_load,
              bool& trigger_screenshot,
@@ -131,6 +194,7 @@ namespace dung
       , m_all_potions(all_potions)
       , m_all_armour(all_armour)
       , m_all_npcs(all_npcs)
+      , m_entity_index(entity_index)
       , m_trigger_game_save(trigger_game_save)
       , m_trigger_game_load(trigger_game_load)
       , m_trigger_screenshot(trigger_screenshot)
@@ -138,6 +202,9 @@ namespace dung
       , m_debug(debug)
     {}
   
+    int get_num_door_state_changes() const { return m_num_door_state_changes; }
+    int get_num_handled_keys() const { return m_num_handled_keys; }
+  
     void handle_keyboard(const t8::KeyPressDataPair& kpdp, double real_time_s)
     {
       auto curr_key = t8::get_char_key(kpdp.transient);
@@ -177,32 +244,38 @@ namespace dung
           bool to_drop_found = false;
           
           find_and_drop_item(to_drop_found, msg, "Keys:", 0,
+                             EntityType::Key,
                              [](Key* /*key*/) -> std::string { return "key"; },
                              curr_pos, dropped_over_liquid,
                              [](Key* key, int /*idx*/) -> int { return key->key_id; },
                              m_all_keys, m_player.key_idcs);
           find_and_drop_item(to_drop_found, msg, "Lamps:", 0,
+                             EntityType::Lamp,
                              [](Lamp* /*lamp*/) -> std::string { return "lamp"; },
                              curr_pos, dropped_over_liquid,
                              [](Lamp* /*lamp*/, int idx) -> int { return idx; },
                              m_all_lamps, m_player.lamp_idcs);
           find_and_drop_item(to_drop_found, msg, "Weapons:", 0, // Melee
+                             EntityType::Weapon,
                              [](Weapon* weapon) -> std::string { return weapon->type; },
                              curr_pos, dropped_over_liquid,
                              [](Weapon* /*weapon*/, int idx) -> int { return idx; },
                              m_all_weapons, m_player.weapon_idcs);
           find_and_drop_item(to_drop_found, msg, "Weapons:", 1, // Ranged
+                             EntityType::Weapon,
                              [](Weapon* weapon) -> std::string { return weapon->type; },
                              curr_pos, dropped_over_liquid,
                              [](Weapon* /*weapon*/, int idx) -> int { return idx; },
                              m_all_weapons, m_player.weapon_idcs);
           find_and_drop_item(to_drop_found, msg, "Potions:", 0,
+                             EntityType::Potion,
                              [](Potion* /*potion*/) -> std::string { return "potion"; },
                              curr_pos, dropped_over_liquid,
                              [](Potion* /*potion*/, int idx) -> int { return idx; },
                              m_all_potions, m_player.potion_idcs);
           for (int a_idx = 0; a_idx < ARMOUR_NUM_ITEMS; ++a_idx)
             find_and_drop_item(to_drop_found, msg, "Armour:", a_idx,
+                               EntityType::Armour,
                                [](Armour* armour) -> std::string { return armour->type; },
                                curr_pos, dropped_over_liquid,
                                [](Armour* /*armour*/, int idx) -> int { return idx; },
@@ -290,6 +363,7 @@ namespace dung
                   // Currently doesn't support locking the door again.
                   // Not sure if we need that. Maybe do it in the far future...
                   door->is_locked = false;
+                  m_num_door_state_changes++;
                   
                   message_handler->add_message(static_cast<float>(real_time_s),
                                                t8::GlyphString::from_ascii("The door is unlocked!"),
@@ -310,7 +384,10 @@ namespace dung
                 }
               }
               else
+              {
                 math::toggle(door->is_open);
+                m_num_door_state_changes++;
+              }
               return true;
             }
             return false;
@@ -366,15 +443,16 @@ namespace dung
           auto too_heavy_msg_template_1 = t8::GlyphString::from_ascii(" is too heavy to carry.");
           auto too_heavy_msg_template_2 = t8::GlyphString::from_ascii("You need to drop items from your inventory!");
           
-          for (size_t key_idx = 0; key_idx < m_all_keys.size(); ++key_idx)
+          for (int key_idx : find_item_idcs_at(EntityType::Key, m_all_keys, curr_pos))
           {
             auto& key = m_all_keys[key_idx];
-            if (key.exists && key.pos == curr_pos && !key.picked_up)
+            if (key.exists && !key.picked_up)
             {
               if (m_player.has_weight_capacity(key.weight))
               {
-                m_player.key_idcs.emplace_back(static_cast<int>(key_idx));
+                m_player.key_idcs.emplace_back(key_idx);
                 key.picked_up = true;
+                m_entity_index.erase(EntityType::Key, key_idx);
                 message_handler->add_message(static_cast<float>(real_time_s),
                                              t8::GlyphString::from_ascii("You picked up a key!"),
                                              t8x::MessageHandlerLevel::Guide);
@@ -387,16 +465,17 @@ namespace dung
                                                         t8x::MessageHandlerLevel::Warning);
             }
           }
-          for (size_t lamp_idx = 0; lamp_idx < m_all_lamps.size(); ++lamp_idx)
+          for (int lamp_idx : find_item_idcs_at(EntityType::Lamp, m_all_lamps, curr_pos))
           {
             auto& lamp = m_all_lamps[lamp_idx];
-            if (lamp.exists && lamp.pos == curr_pos && !lamp.picked_up)
+            if (lamp.exists && !lamp.picked_up)
             {
               auto lamp_type = lamp.get_type_str();
               if (m_player.has_weight_capacity(lamp.weight))
               {
-                m_player.lamp_idcs.emplace_back(static_cast<int>(lamp_idx));
+                m_player.lamp_idcs.emplace_back(lamp_idx);
                 lamp.picked_up = true;
+                m_entity_index.erase(EntityType::Lamp, lamp_idx);
                 message_handler->add_message(static_cast<float>(real_time_s),
                                              t8::GlyphString::from_ascii("You picked up " + str::indef_art(lamp_type) + "!"),
                                              t8x::MessageHandlerLevel::Guide);
@@ -409,15 +488,16 @@ namespace dung
                                                         t8x::MessageHandlerLevel::Warning);
             }
           }
-          for (size_t wpn_idx = 0; wpn_idx < m_all_weapons.size(); ++wpn_idx)
+          for (int wpn_idx : find_item_idcs_at(EntityType::Weapon, m_all_weapons, curr_pos))
           {
             auto& weapon = m_all_weapons[wpn_idx];
-            if (weapon->exists && weapon->pos == curr_pos && !weapon->picked_up)
+            if (weapon->exists && !weapon->picked_up)
             {
               if (m_player.has_weight_capacity(weapon->weight))
               {
-                m_player.weapon_idcs.emplace_back(static_cast<int>(wpn_idx));
+                m_player.weapon_idcs.emplace_back(wpn_idx);
                 weapon->picked_up = true;
+                m_entity_index.erase(EntityType::Weapon, wpn_idx);
                 message_handler->add_message(static_cast<float>(real_time_s),
                                              t8::GlyphString::from_ascii("You picked up " + str::indef_art(weapon->type) + "!"),
                                              t8x::MessageHandlerLevel::Guide);
@@ -430,15 +510,16 @@ namespace dung
                                                         t8x::MessageHandlerLevel::Warning);
             }
           }
-          for (size_t pot_idx = 0; pot_idx < m_all_potions.size(); ++pot_idx)
+          for (int pot_idx : find_item_idcs_at(EntityType::Potion, m_all_potions, curr_pos))
           {
             auto& potion = m_all_potions[pot_idx];
-            if (potion.exists && potion.pos == curr_pos && !potion.picked_up)
+            if (potion.exists && !potion.picked_up)
             {
               if (m_player.has_weight_capacity(potion.weight))
               {
-                m_player.potion_idcs.emplace_back(static_cast<int>(pot_idx));
+                m_player.potion_idcs.emplace_back(pot_idx);
                 potion.picked_up = true;
+                m_entity_index.erase(EntityType::Potion, pot_idx);
                 message_handler->add_message(static_cast<float>(real_time_s),
                                              t8::GlyphString::from_ascii("You picked up a potion!"),
                                              t8x::MessageHandlerLevel::Guide);
@@ -451,15 +532,16 @@ namespace dung
                                                         t8x::MessageHandlerLevel::Warning);
             }
           }
-          for (size_t a_idx = 0; a_idx < m_all_armour.size(); ++a_idx)
+          for (int a_idx : find_item_idcs_at(EntityType::Armour, m_all_armour, curr_pos))
           {
             auto& armour = m_all_armour[a_idx];
-            if (armour->exists && armour->pos == curr_pos && !armour->picked_up)
+            if (armour->exists && !armour->picked_up)
             {
               if (m_player.has_weight_capacity(armour->weight))
               {
-                m_player.armour_idcs.emplace_back(static_cast<int>(a_idx));
+                m_player.armour_idcs.emplace_back(a_idx);
                 armour->picked_up = true;
+                m_entity_index.erase(EntityType::Armour, a_idx);
                 message_handler->add_message(static_cast<float>(real_time_s),
                                              t8::GlyphString::from_ascii("You picked up " + str::indef_art(armour->type) + "!"),
                                              t8x::MessageHandlerLevel::Guide);
@@ -487,15 +569,18 @@ namespace dung
         math::toggle(m_debug);
       else if (str::to_lower(curr_key) == 'i')
       {
-        for (const auto& key : m_all_keys)
+        const auto& floor_bucket = m_entity_index.fetch_floor_bucket(m_player.curr_floor);
+        for (int key_idx : floor_bucket.key_idcs)
         {
+          const auto& key = m_all_keys[key_idx];
           if (key.visible_near)
             message_handler->add_message(static_cast<float>(real_time_s),
                                          t8::GlyphString::from_ascii("You see a key nearby!"),
                                          t8x::MessageHandlerLevel::Guide);
         }
-        for (const auto& lamp : m_all_lamps)
+        for (int lamp_idx : floor_bucket.lamp_idcs)
         {
+          const auto& lamp = m_all_lamps[lamp_idx];
           if (lamp.visible_near)
           {
             auto lamp_type = lamp.get_type_str();
@@ -504,29 +589,33 @@ namespace dung
                                          t8x::MessageHandlerLevel::Guide);
           }
         }
-        for (const auto& weapon : m_all_weapons)
+        for (int wpn_idx : floor_bucket.weapon_idcs)
         {
+          const auto& weapon = m_all_weapons[wpn_idx];
           if (weapon->visible_near)
             message_handler->add_message(static_cast<float>(real_time_s),
                                          t8::GlyphString::from_ascii("You can see " + str::indef_art(weapon->type) + " nearby!"),
                                          t8x::MessageHandlerLevel::Guide);
         }
-        for (const auto& potion : m_all_potions)
+        for (int pot_idx : floor_bucket.potion_idcs)
         {
+          const auto& potion = m_all_potions[pot_idx];
           if (potion.visible_near)
             message_handler->add_message(static_cast<float>(real_time_s),
                                          t8::GlyphString::from_ascii("You can see a potion nearby!"),
                                          t8x::MessageHandlerLevel::Guide);
         }
-        for (const auto& armour : m_all_armour)
+        for (int a_idx : floor_bucket.armour_idcs)
         {
+          const auto& armour = m_all_armour[a_idx];
           if (armour->visible_near)
             message_handler->add_message(static_cast<float>(real_time_s),
                                          t8::GlyphString::from_ascii("You can see " + str::indef_art(armour->type) + " nearby!"),
                                          t8x::MessageHandlerLevel::Guide);
         }
-        for (const auto& npc : m_all_npcs)
+        for (int npc_idx : floor_bucket.npc_idcs)
         {
+          const auto& npc = m_all_npcs[npc_idx];
           if (npc.visible_near)
           {
             auto race = race2str(npc.npc_race);
@@ -594,6 +683,10 @@ namespace dung
       {
         m_trigger_screenshot = true;
       }
+      else
+        return;
+        
+      m_num_handled_keys++;
     }
 
   };
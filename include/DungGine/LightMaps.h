@@ -0,0 +1,181 @@
+//
+//  LightMaps.h
+//  DungGine
+//
+//  Created by Rasmus Anthin on 2026-10-17.
+//
+
+#pragma once
+#include "BSPTree.h"
+#include "Corridor.h"
+#include "LightStencils.h"
+#include "ShadowCasting.h"
+#include "BitPlane.h"
+#include <Core/StlUtils.h>
+#include <vector>
+
+
+namespace dung
+{
+
+  // A lamp lying in a room or in a corridor.
+  struct StaticLightSource
+  {
+    RC pos;
+    int radius_q = 0; // Radius in tenths of a textel.
+
+    bool operator==(const StaticLightSource&) const = default;
+  };
+
+  // Light from the lamps lying around on each floor, baked once per room and corridor.
+  // A lightmap is only rebaked when the set of lamps inside its region changes,
+  //   i.e. when a lamp is dropped, picked up or has burnt out.
+  // The light of the selected lamp of the PC is composited on top of it by DungGine.
+  class StaticLightMaps
+  {
+    struct LightMap
+    {
+      std::vector<StaticLightSource> sources;
+      Rectangle bb;
+      BitPlane lit; // Covers the same rectangle as the light field of the region.
+
+      bool is_lit(const RC& world_pos) const
+      {
+        auto local_pos = world_pos - bb.pos();
+        return lit.get(local_pos.r, local_pos.c);
+      }
+    };
+
+    struct FloorLightMaps
+    {
+      std::vector<LightMap> room_maps; // Indexed by BSPNode::id.
+      std::vector<LightMap> corridor_maps; // Indexed by Corridor::id.
+    };
+
+    std::vector<FloorLightMaps> m_floors;
+    FovMask m_fov;
+    int m_generation = 0; // Bumped whenever a lightmap is rebaked.
+
+    const LightMap* find_map(const std::vector<LightMap>& maps, int id) const
+    {
+      if (!stlutils::in_range(maps, id))
+        return nullptr;
+      return &maps[id];
+    }
+
+    const LightMap* find_room_map(int floor, const BSPNode* room) const
+    {
+      if (room == nullptr || !stlutils::in_range(m_floors, floor))
+        return nullptr;
+      return find_map(m_floors[floor].room_maps, room->id);
+    }
+
+    const LightMap* find_corridor_map(int floor, const Corridor* corridor) const
+    {
+      if (corridor == nullptr || !stlutils::in_range(m_floors, floor))
+        return nullptr;
+      return find_map(m_floors[floor].corridor_maps, corridor->id);
+    }
+
+    template<typename LambdaOpaque>
+    void bake(LightMap& light_map, const Rectangle& bb, LightStencilCache& stencils, LambdaOpaque& f_is_opaque)
+    {
+      light_map.bb = bb;
+      light_map.lit.reset(bb.r_len, bb.c_len);
+      for (const auto& src : light_map.sources)
+      {
+        const auto& stencil = stencils.fetch_stencil(0.1f*src.radius_q, 0.f, Lamp::LightType::Isotropic, 0.f, 0.f);
+        m_fov.reset(bb);
+        m_fov.cast(src.pos, stencil.max_dist, f_is_opaque);
+        auto local_pos = src.pos - bb.pos();
+        for (const auto& span : stencil.spans)
+          light_map.lit.or_span(m_fov.get_plane(), local_pos.r + span.r_offs,
+                                local_pos.c + span.c_offs_start, local_pos.c + span.c_offs_end);
+      }
+    }
+
+    template<typename LambdaOpaque>
+    bool update_map(std::vector<LightMap>& maps, int id, const Rectangle& bb,
+                    std::vector<StaticLightSource>&& sources,
+                    LightStencilCache& stencils, LambdaOpaque& f_is_opaque)
+    {
+      if (id < 0)
+        return false;
+      if (!stlutils::in_range(maps, id) && sources.empty())
+        return false;
+      auto& light_map = stlutils::at_growing(maps, id);
+      if (light_map.sources == sources)
+        return false;
+      light_map.sources = std::move(sources);
+      bake(light_map, bb, stencils, f_is_opaque);
+      m_generation++;
+      return true;
+    }
+
+    // A word at a time.
+    static void copy_to(const LightMap* light_map, BitPlaneView& light)
+    {
+      if (light_map == nullptr ||
+          light_map->bb.r_len != light.num_rows() || light_map->bb.c_len != light.num_cols())
+      {
+        light.fill(false);
+        return;
+      }
+      light.assign(light_map->lit);
+    }
+
+  public:
+    void reset(int num_floors)
+    {
+      m_floors.assign(num_floors, {});
+      m_generation++;
+    }
+
+    // f_is_opaque(const RC& world_pos) -> bool.
+    // Returns true if the lightmap of the room had to be rebaked.
+    template<typename LambdaOpaque>
+    bool update_room(int floor, const BSPNode* room, std::vector<StaticLightSource> sources,
+                     LightStencilCache& stencils, LambdaOpaque f_is_opaque)
+    {
+      if (room == nullptr || !stlutils::in_range(m_floors, floor))
+        return false;
+      return update_map(m_floors[floor].room_maps, room->id, room->bb_leaf_room,
+                        std::move(sources), stencils, f_is_opaque);
+    }
+
+    // f_is_opaque(const RC& world_pos) -> bool.
+    // Returns true if the lightmap of the corridor had to be rebaked.
+    template<typename LambdaOpaque>
+    bool update_corridor(int floor, const Corridor* corridor, std::vector<StaticLightSource> sources,
+                         LightStencilCache& stencils, LambdaOpaque f_is_opaque)
+    {
+      if (corridor == nullptr || !stlutils::in_range(m_floors, floor))
+        return false;
+      return update_map(m_floors[floor].corridor_maps, corridor->id, corridor->bb,
+                        std::move(sources), stencils, f_is_opaque);
+    }
+
+    // Checks the lightmap of the room first and then the one of the corridor.
+    bool is_lit(int floor, const BSPNode* room, const Corridor* corridor, const RC& world_pos) const
+    {
+      const auto* room_map = find_room_map(floor, room);
+      if (room_map != nullptr && room_map->is_lit(world_pos))
+        return true;
+      const auto* corr_map = find_corridor_map(floor, corridor);
+      return corr_map != nullptr && corr_map->is_lit(world_pos);
+    }
+
+    void copy_to(int floor, const BSPNode* room, BitPlaneView& light) const
+    {
+      copy_to(find_room_map(floor, room), light);
+    }
+
+    void copy_to(int floor, const Corridor* corridor, BitPlaneView& light) const
+    {
+      copy_to(find_corridor_map(floor, corridor), light);
+    }
+
+    int get_generation() const { return m_generation; }
+  };
+
+}
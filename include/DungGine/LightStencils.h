@@ -0,0 +1,133 @@
+//
+//  LightStencils.h
+//  DungGine
+//
+//  Created by Rasmus Anthin on 2026-10-17.
+//
+
+#pragma once
+#include "Items.h"
+#include "Globals.h"
+#include <Termin8or/drawing/Drawing.h>
+#include <Termin8or/geom/RC.h>
+#include <Core/MathUtils.h>
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <vector>
+
+
+namespace dung
+{
+
+  // Horizontal run of textels relative to the light source.
+  struct StencilSpan
+  {
+    int r_offs = 0;
+    int c_offs_start = 0;
+    int c_offs_end = 0; // Inclusive.
+  };
+
+  struct LightStencil
+  {
+    std::vector<StencilSpan> spans;
+    int max_dist = 0; // Largest row or column offset of any span.
+  };
+
+  // The shapes of filled_circle_positions() and filled_arc_positions() stored as row spans.
+  class LightStencilCache
+  {
+    static constexpr float c_radius_quantum = 0.1f;
+    static constexpr int c_num_los_sectors = 64;
+    static constexpr size_t c_max_num_stencils = 512;
+
+    struct Key
+    {
+      int radius_q = 0;
+      int px_aspect_q = 0;
+      Lamp::LightType light_type = Lamp::LightType::Isotropic;
+      int angle_deg_q = 0;
+      int los_sector = -1; // -1 : no LOS direction.
+
+      bool operator<(const Key& other) const
+      {
+        return std::tie(radius_q, px_aspect_q, light_type, angle_deg_q, los_sector) <
+          std::tie(other.radius_q, other.px_aspect_q, other.light_type, other.angle_deg_q, other.los_sector);
+      }
+    };
+
+    std::map<Key, LightStencil> m_stencils;
+
+    static LightStencil calc_stencil(std::vector<RC> positions)
+    {
+      std::sort(positions.begin(), positions.end(),
+                [](const RC& pA, const RC& pB) { return std::tie(pA.r, pA.c) < std::tie(pB.r, pB.c); });
+      LightStencil stencil;
+      auto& spans = stencil.spans;
+      for (const auto& p : positions)
+      {
+        if (!spans.empty() && spans.back().r_offs == p.r && p.c <= spans.back().c_offs_end + 1)
+          spans.back().c_offs_end = std::max(spans.back().c_offs_end, p.c);
+        else
+          spans.push_back({ p.r, p.c, p.c });
+        math::maximize(stencil.max_dist, std::max(std::abs(p.r), std::abs(p.c)));
+      }
+      return stencil;
+    }
+
+  public:
+    // The radius is quantized so that burning lamps don't produce a new stencil every frame.
+    const LightStencil& fetch_stencil(float radius, float angle_deg, Lamp::LightType light_type,
+                                      float los_r, float los_c)
+    {
+      Key key;
+      key.radius_q = math::roundI(radius / c_radius_quantum);
+      key.px_aspect_q = math::roundI(100.f*globals::px_aspect);
+      key.light_type = light_type;
+      if (light_type == Lamp::LightType::Directional)
+      {
+        key.angle_deg_q = math::roundI(angle_deg);
+        if (los_r != 0.f || los_c != 0.f)
+        {
+          auto los_angle_rad = math::atan2n(-los_r, los_c);
+          auto sector = math::roundI(c_num_los_sectors * los_angle_rad / math::c_2pi);
+          key.los_sector = (sector % c_num_los_sectors + c_num_los_sectors) % c_num_los_sectors;
+        }
+      }
+
+      auto it = m_stencils.find(key);
+      if (it != m_stencils.end())
+        return it->second;
+
+      if (m_stencils.size() >= c_max_num_stencils)
+        m_stencils.clear();
+
+      auto radius_q = key.radius_q * c_radius_quantum;
+      std::vector<RC> positions;
+      switch (light_type)
+      {
+        case Lamp::LightType::Isotropic:
+          positions = t8x::filled_circle_positions({ 0, 0 }, radius_q, globals::px_aspect);
+          break;
+        case Lamp::LightType::Directional:
+        {
+          float dir_r = 0.f;
+          float dir_c = 0.f;
+          if (key.los_sector != -1)
+          {
+            auto los_angle_rad = math::c_2pi * key.los_sector / c_num_los_sectors;
+            dir_r = -std::sin(los_angle_rad);
+            dir_c = std::cos(los_angle_rad);
+          }
+          positions = t8x::filled_arc_positions({ 0, 0 }, radius_q, math::deg2rad(static_cast<float>(key.angle_deg_q)),
+                                                dir_r, dir_c, globals::px_aspect);
+          break;
+        }
+        case Lamp::LightType::NUM_ITEMS:
+          break;
+      }
+      return m_stencils[key] = calc_stencil(std::move(positions));
+    }
+  };
+
+}
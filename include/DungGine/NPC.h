@@ -9,6 +9,9 @@
 #include "Items.h"
 #include "Globals.h"
 #include "PlayerBase.h"
+#include "RandomStream.h"
+#include "NPCKinematics.h"
+#include "FlowField.h"
 #include <Core/OneShot.h>
 
 
@@ -122,9 +125,29 @@ namespace dung
     float death_time_s = 0.f;
     OneShot trg_death;
     
+    // Used instead of the global rnd:: functions by the updates, so that the NPCs
+    //   can be updated in any order. Seeded when the NPC is placed.
+    RandomStream rng;
+    
+    // One stream per NPC, derived from the game seed and the index of the NPC.
+    void seed_rng(unsigned int rnd_seed, int npc_idx)
+    {
+      rng.seed((static_cast<uint64_t>(rnd_seed) << 32) | static_cast<uint32_t>(npc_idx));
+    }
+    bool tick_pending = false; // Between update_pre() and update_post().
+    
+    // Sim time of the last tick. DungGine skips the updates of NPCs on other floors than the PC.
+    float last_tick_time_s = 0.f;
+    static constexpr float c_catch_up_scatter_time_s = 5.f;
+    
   private:
     
-    void move(const RC& pc_pos, Environment* environment, float dt)
+    virtual bool rnd_one_in(int n) override { return rng.one_in(n); }
+    virtual float rnd_rand() override { return rng.rand(); }
+    
+    // First part of a move : acceleration and velocity, but not the position.
+    // pursuit_field is optional and leads pursuing NPCs around walls and through doors towards the PC.
+    void steer(const RC& pc_pos, const FlowField* pursuit_field, float dt)
     {
       if (wall_coll_resolve)
       {
@@ -134,10 +157,10 @@ namespace dung
           wall_coll_resolve = false;
         }
       }
-      else if (rnd::one_in(prob_change_acc))
+      else if (rng.one_in(prob_change_acc))
       {
-        acc_r += rnd::randn_range(-acc_step, +acc_step);
-        acc_c += rnd::randn_range(-acc_step*px_aspect, +acc_step*px_aspect);
+        acc_r += rng.randn_range(-acc_step, +acc_step);
+        acc_c += rng.randn_range(-acc_step*px_aspect, +acc_step*px_aspect);
         acc_r = math::clamp<float>(acc_r, -acc_lim*acc_factor, +acc_lim*acc_factor);
         acc_c = math::clamp<float>(acc_c, -acc_lim*acc_factor*px_aspect, +acc_lim*acc_factor*px_aspect);
       }
@@ -151,6 +174,18 @@ namespace dung
         case State::FightMelee:
         {
           const int c_fight_min_dist = state == State::FightRanged ? c_fight_min_dist_ranged : c_fight_min_dist_melee;
+          
+          if (pursuit_field != nullptr)
+          {
+            int num_steps = pursuit_field->get_distance(pos);
+            auto step_dir = pursuit_field->get_step_dir(pos);
+            if (step_dir.has_value() && num_steps > c_fight_min_dist)
+            {
+              vel_r = 0.5f * (num_steps - c_fight_min_dist) * step_dir->r;
+              vel_c = 0.5f * (num_steps - c_fight_min_dist) * step_dir->c;
+              break;
+            }
+          }
         
           //vel_r = 0.5f * (pc_pos.r - pos.r);
           //vel_c = 0.5f * (pc_pos.c - pos.c);
@@ -170,10 +205,11 @@ namespace dung
         case State::NUM_ITEMS:
           break;
       }
-      vel_r = math::clamp<float>(vel_r, -vel_lim, +vel_lim);
-      vel_c = math::clamp<float>(vel_c, -vel_lim*vel_factor*px_aspect, +vel_lim*vel_factor*px_aspect);
-      pos_r += vel_r*dt;
-      pos_c += vel_c*dt;
+    }
+    
+    // Last part of a move : from the integrated position to a valid cell.
+    void resolve_move(Environment* environment)
+    {
       auto r = math::roundI(pos_r);
       auto c = math::roundI(pos_c);
       auto location_corr = BBLocation::None;
@@ -186,8 +222,9 @@ namespace dung
         inside_room = curr_room->is_inside_room({r, c}, &location_corr);
       if (inside_room || inside_corr)
       {
-        bool ok_move_to = environment->allow_move_to(curr_floor, r, c);
-        bool wet = is_wet(environment->get_terrain(curr_floor, r, c));
+        auto terrain_cell = environment->get_terrain_cell(curr_floor, { r, c });
+        bool ok_move_to = terrain_cell.allow_move_to();
+        bool wet = terrain_cell.is_wet();
         bool allow_walking = ok_move_to && !wet;
         bool allow_swimming = ok_move_to && can_swim && wet;
         bool allow_flying = can_fly;
@@ -204,7 +241,7 @@ namespace dung
         wall_coll_resolve_ctr = 0;
         wall_coll_resolve = false;
       }
-      else if (!wall_coll_resolve && rnd::one_in(6))
+      else if (!wall_coll_resolve && rng.one_in(6))
       {
         auto location = BBLocation::None;
         if (location_room != BBLocation::None && location_corr != BBLocation::None)
@@ -749,10 +786,31 @@ namespace dung
           is_hostile = true;
     }
     
-    void update(const RC& pc_pos, BSPNode* pc_room, Corridor* pc_corr,
-                Environment* environment,
-                bool do_los_terrainos, bool do_move,
-                float time, float dt)
+    // The motion state that is integrated by NPCKinematics::integrate() between update_pre() and update_post().
+    void store_kinematics(NPCKinematics& kinematics, int idx, float dt) const
+    {
+      kinematics.pos_r[idx] = pos_r;
+      kinematics.pos_c[idx] = pos_c;
+      kinematics.vel_r[idx] = vel_r;
+      kinematics.vel_c[idx] = vel_c;
+      kinematics.vel_lim_r[idx] = vel_lim;
+      kinematics.vel_lim_c[idx] = vel_lim*vel_factor*px_aspect;
+      kinematics.dt[idx] = dt;
+    }
+    
+    void load_kinematics(const NPCKinematics& kinematics, int idx)
+    {
+      pos_r = kinematics.pos_r[idx];
+      pos_c = kinematics.pos_c[idx];
+      vel_r = kinematics.vel_r[idx];
+      vel_c = kinematics.vel_c[idx];
+    }
+    
+    // Everything up to the integration of the velocity. Returns true if the NPC moves this tick.
+    bool update_pre(const RC& pc_pos, BSPNode* pc_room, Corridor* pc_corr,
+                    const FlowField* pursuit_field,
+                    bool do_los_terrainos, bool do_move,
+                    float time, float dt)
     {
       if (health <= 0)
       {
@@ -760,8 +818,9 @@ namespace dung
           death_time_s = time;
         glyph = '&';
         style = { Color16::Red, Color16::DarkGray };
-        return;
+        return false;
       }
+      tick_pending = true;
       
       if (do_los_terrainos)
       {
@@ -769,7 +828,7 @@ namespace dung
         update_terrain();
       }
       
-      if (rnd::one_in(prob_slow_fast))
+      if (rng.one_in(prob_slow_fast))
       {
         math::toggle(slow);
         if (slow)
@@ -836,8 +895,22 @@ namespace dung
       else if (!can_see_pc || dist_to_pc > c_dist_patroll)
         state = State::Patroll;
       
-      if (allow_move())
-        move(pc_pos, environment, dt);
+      if (!allow_move())
+        return false;
+      steer(pc_pos, pursuit_field, dt);
+      return true;
+    }
+    
+    // Everything after the integration of the velocity.
+    void update_post(Environment* environment, bool moved)
+    {
+      // Nothing more to do for an NPC that was already dead at update_pre().
+      if (!tick_pending)
+        return;
+      tick_pending = false;
+      
+      if (moved)
+        resolve_move(environment);
       
       if (inside_room && curr_room != nullptr)
       {
@@ -910,6 +983,49 @@ namespace dung
       }
     }
     
+    // Statistical stand-in for the ticks that were skipped since last_tick_time_s.
+    // A patrolling NPC has lost any memory of where it was after a few seconds,
+    //   so it is put on a random cell of its room or corridor, at rest.
+    void catch_up(Environment* environment, float time)
+    {
+      float elapsed = time - last_tick_time_s;
+      last_tick_time_s = time;
+      if (health <= 0 || elapsed <= 0.f)
+        return;
+      
+      acc_r = 0.f;
+      acc_c = 0.f;
+      vel_r = 0.f;
+      vel_c = 0.f;
+      is_hostile = false;
+      was_hostile = false;
+      state = State::Patroll;
+      wall_coll_resolve = false;
+      wall_coll_resolve_ctr = 0;
+      if (elapsed < c_catch_up_scatter_time_s)
+        return;
+      
+      const auto* bb = inside_room && curr_room != nullptr ? &curr_room->bb_leaf_room :
+        (inside_corr && curr_corridor != nullptr ? &curr_corridor->bb : nullptr);
+      if (bb == nullptr)
+        return;
+      const int c_max_num_tries = 20;
+      for (int i = 0; i < c_max_num_tries; ++i)
+      {
+        RC p { rng.rand_int(bb->r, bb->r + bb->r_len - 1), rng.rand_int(bb->c, bb->c + bb->c_len - 1) };
+        bool inside = inside_room ? curr_room->bb_leaf_room.is_inside_offs(p, -1) : curr_corridor->is_inside_corridor(p);
+        if (!inside)
+          continue;
+        auto terrain_cell = environment->get_terrain_cell(curr_floor, p);
+        if (!can_fly && (!terrain_cell.allow_move_to() || (terrain_cell.is_wet() && !can_swim)))
+          continue;
+        pos = p;
+        pos_r = static_cast<float>(p.r);
+        pos_c = static_cast<float>(p.c);
+        break;
+      }
+    }
+    
     float distance_to_pc() const
     {
       return dist_to_pc;
@@ -978,6 +1094,8 @@ namespace dung
       sg::write_var(lines, SG_WRITE_VAR(is_hostile));
       sg::write_var(lines, SG_WRITE_VAR(was_hostile));
       // OneShot trg_info_hostile_npc;
+      auto rng_state = rng.get_state();
+      sg::write_var(lines, SG_WRITE_VAR(rng_state));
       sg::write_var(lines, SG_WRITE_VAR(death_time_s));
       // OneShot trg_death;
     }
@@ -987,6 +1105,7 @@ namespace dung
                                                            Environment* environment) override
     {
       it_line_begin = PlayerBase::deserialize(it_line_begin, it_line_end, environment);
+      std::vector<uint32_t> rng_state;
       for (auto it_line = it_line_begin + 1; it_line != it_line_end; ++it_line)
       {
         if (sg::read_var(&it_line, SG_READ_VAR(pos_r))) {}
@@ -1021,6 +1140,8 @@ namespace dung
         else if (sg::read_var(&it_line, SG_READ_VAR(is_hostile))) {}
         else if (sg::read_var(&it_line, SG_READ_VAR(was_hostile))) {}
         // OneShot trg_info_hostile_npc;
+        else if (sg::read_var(&it_line, SG_READ_VAR(rng_state)))
+          rng.set_state(rng_state);
         else if (sg::read_var(&it_line, SG_READ_VAR(death_time_s)))
         {
           return it_line;
@@ -0,0 +1,58 @@
+//
+//  NPCKinematics.h
+//  DungGine
+//
+//  Created by Rasmus Anthin on 2026-10-17.
+//
+
+#pragma once
+#include <algorithm>
+#include <vector>
+
+
+namespace dung
+{
+
+  // Motion state of the NPCs that move this tick, one contiguous array per component.
+  // Packed, so that the NPCs that stand still or are not ticked take no room.
+  // Filled in by NPC::store_kinematics() after steering and read back by
+  //   NPC::load_kinematics() before the terrain and collision checks.
+  struct NPCKinematics
+  {
+    std::vector<float> pos_r;
+    std::vector<float> pos_c;
+    std::vector<float> vel_r;
+    std::vector<float> vel_c;
+    std::vector<float> vel_lim_r;
+    std::vector<float> vel_lim_c;
+    std::vector<float> dt; // Zero for NPCs that don't move this tick.
+
+    void resize(int num_npcs)
+    {
+      for (auto* comp : { &pos_r, &pos_c, &vel_r, &vel_c, &vel_lim_r, &vel_lim_c, &dt })
+        comp->resize(num_npcs);
+    }
+
+    // Clamps the velocities and integrates the positions of NPCs idx_start .. idx_end - 1.
+    void integrate(int idx_start, int idx_end)
+    {
+      integrate_kernel(pos_r.data(), vel_r.data(), vel_lim_r.data(), dt.data(), idx_start, idx_end);
+      integrate_kernel(pos_c.data(), vel_c.data(), vel_lim_c.data(), dt.data(), idx_start, idx_end);
+    }
+    
+  private:
+    // One component at a time. No branches and no aliasing, so that the compiler can vectorise the loop.
+    static void integrate_kernel(float* __restrict pos, float* __restrict vel,
+                                 const float* __restrict vel_lim, const float* __restrict step,
+                                 int idx_start, int idx_end)
+    {
+      for (int i = idx_start; i < idx_end; ++i)
+      {
+        float v = std::clamp(vel[i], -vel_lim[i], vel_lim[i]);
+        vel[i] = v;
+        pos[i] += v*step[i];
+      }
+    }
+  };
+
+}
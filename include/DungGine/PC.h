@@ -37,7 +37,9 @@ namespace dung
     float weight_capacity_hard = 70.f;
     float curr_tot_inv_weight = 0.f;
     
+    static constexpr float c_fire_smoke_life_time_s = 0.2f;
     t8x::ParticleHandler fire_smoke_engine { 500 };
+    float fire_smoke_trg_time_s = -1.f; // Sim time of the last frame that emitted smoke.
     
     t8x::ParticleGradientGroup<t8::GlyphString> smoke_0
     {
@@ -116,7 +118,7 @@ namespace dung
     {
       const float vel_r = -10*los_r;
       const float vel_c = -10*los_c;
-      const float acc = 0.f, life_time = 0.2f;
+      const float acc = 0.f, life_time = c_fire_smoke_life_time_s;
       float spread = 23.f;
       const int cluster_size = 10;
       auto* curr_lamp = get_selected_lamp(inventory);
@@ -129,6 +131,8 @@ namespace dung
         spread = curr_lamp->radius*2.f;
       }
       fire_smoke_engine.update(screen_helper->get_screen_pos(pos), trg, vel_r, vel_c, acc, spread, life_time, cluster_size, sim_dt, sim_time);
+      if (trg)
+        fire_smoke_trg_time_s = sim_time;
     }
     
   public:
@@ -155,10 +159,24 @@ namespace dung
       weight_strain = math::value_to_param_clamped(curr_tot_inv_weight, weight_capacity_soft, weight_capacity_hard);
     }
     
+    // True while there are smoke particles left to animate.
+    bool has_fire_smoke(float sim_time) const
+    {
+      auto dt = sim_time - fire_smoke_trg_time_s;
+      return fire_smoke_trg_time_s >= 0.f && 0.f <= dt && dt <= c_fire_smoke_life_time_s;
+    }
+    
+    template<int NR, int NC, typename CharT>
+    void draw(ScreenHandler<NR, NC, CharT>& sh, float sim_time) const
+    {
+      draw_fire_smoke(sh, fire_smoke_engine, sim_time);
+    }
+    
+    // Draws a copy of fire_smoke_engine, e.g. the one of a render snapshot.
     template<int NR, int NC, typename CharT>
-    void draw(ScreenHandler<NR, NC, CharT>& sh, float sim_time)
+    void draw_fire_smoke(ScreenHandler<NR, NC, CharT>& sh, const t8x::ParticleHandler& smoke_engine, float sim_time) const
     {
-      fire_smoke_engine.draw(sh, smoke_color_gradients, sim_time);
+      smoke_engine.draw(sh, smoke_color_gradients, sim_time);
 #ifdef DEBUG_FIRE_SMOKE
       int c_offs = 0;
       for (const auto& grad : smoke_color_gradients)
@@ -0,0 +1,433 @@
+//
+//  PathFinder.h
+//  DungGine
+//
+//  Created by Rasmus Anthin on 2026-10-17.
+//
+
+#pragma once
+#include "Environment.h"
+#include "FlowField.h"
+#include <Core/StlUtils.h>
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <limits>
+#include <map>
+#include <queue>
+#include <vector>
+
+
+namespace dung
+{
+
+  // One waypoint of a route from PathFinder::find_route().
+  struct PathWaypoint
+  {
+    int floor = 0;
+    RC pos; // world pos
+    // Room or corridor that the leg ending at this waypoint lies in.
+    // -1 for the first waypoint and for a leg that takes a staircase to another floor.
+    int leg_region_idx = -1;
+  };
+
+  // Hierarchical pathfinder (HPA* style) over all the floors of a dungeon.
+  // The rooms and the corridors are the regions of an abstract graph, linked by portals :
+  //   the doors and the two ends of each staircase.
+  // build() finds the cost between each pair of portals of a region once, so a query
+  //   only needs an A* search over the portals. The cells of a route are found one leg
+  //   at a time by refine_leg().
+  // Queries are const and may run concurrently, as long as each thread passes its own Scratch.
+  class PathFinder
+  {
+  public:
+    // Buffers of the queries. Keep one around per thread to not reallocate them on every query.
+    struct Scratch
+    {
+      FlowField field;
+      std::vector<int> start_dists;
+      std::vector<int> goal_dists;
+      std::vector<int> g;
+      std::vector<int> parent;
+      std::vector<int> via_region;
+      std::vector<char> closed;
+    };
+
+  private:
+    struct Region
+    {
+      int floor = 0;
+      BSPNode* room = nullptr;
+      Corridor* corridor = nullptr;
+      Rectangle bb;
+      FlowField field; // Local to bb. Only used for its walkable cells by the queries.
+      std::vector<int> portals; // Portal indices.
+      std::vector<int> costs; // Between the portals of the region, row-major. -1 if not connected.
+
+      RC to_local(const RC& world_pos) const { return world_pos - bb.pos(); }
+    };
+
+    struct Portal
+    {
+      int floor = 0;
+      RC pos; // world pos
+      Door* door = nullptr; // Either a door
+      Staircase* staircase = nullptr; // or one end of a staircase.
+      int other_end = -1; // Portal at the other end of the staircase.
+      std::vector<std::pair<int, int>> regions; // Region index and index into Region::portals.
+    };
+
+    std::vector<Region> m_regions;
+    std::vector<Portal> m_portals;
+    std::vector<std::vector<int>> m_floor_regions;
+    // Per floor, the region of each world cell, row-major. -1 outside of all the regions.
+    // Where a door is shared by a room and a corridor, the region added first wins.
+    std::vector<std::vector<int>> m_floor_region_grids;
+    std::vector<RC> m_floor_sizes;
+    bool m_built = false;
+
+    static constexpr int c_staircase_cost = 1;
+
+    static int calc_max_dist(const Region& region)
+    {
+      return std::min(region.bb.r_len * region.bb.c_len, 0xFFFE);
+    }
+
+    // Searches the region from world_pos, using field as the scratch field.
+    static void compute_field(const Region& region, const RC& world_pos, FlowField& field)
+    {
+      field.assign_walkable(region.field);
+      field.compute(region.to_local(world_pos), calc_max_dist(region));
+    }
+
+    // Distances from world_pos to every portal of the region, -1 for the ones that cannot be reached.
+    static void calc_portal_dists(const Region& region, const std::vector<Portal>& portals,
+                                  const RC& world_pos, FlowField& field, std::vector<int>& dists)
+    {
+      compute_field(region, world_pos, field);
+      dists.clear();
+      for (int portal_idx : region.portals)
+        dists.emplace_back(field.get_distance(region.to_local(portals[portal_idx].pos)));
+    }
+
+    int add_region(int floor, BSPNode* room, Corridor* corridor, const Environment& environment)
+    {
+      auto& region = m_regions.emplace_back();
+      region.floor = floor;
+      region.room = room;
+      region.corridor = corridor;
+      region.bb = room != nullptr ? room->bb_leaf_room : corridor->bb;
+      region.field.reset({ region.bb.r_len, region.bb.c_len });
+      auto f_add_cell = [&](const RC& pos)
+      {
+        if (environment.allow_move_to(floor, pos.r, pos.c))
+          region.field.set_walkable(region.to_local(pos), true);
+      };
+      for (int r = region.bb.top(); r <= region.bb.bottom(); ++r)
+        for (int c = region.bb.left(); c <= region.bb.right(); ++c)
+        {
+          bool inside = room != nullptr ? region.bb.is_inside_offs({ r, c }, -1) :
+            corridor->is_inside_corridor({ r, c });
+          if (inside)
+            f_add_cell({ r, c });
+        }
+      // Whether the doors are open or not is up to the queries.
+      if (room != nullptr)
+        for (auto* door : room->doors)
+          f_add_cell(door->pos);
+      else
+        for (auto* door : corridor->doors)
+          f_add_cell(door->pos);
+      region.field.set_baked();
+      int region_idx = stlutils::sizeI(m_regions) - 1;
+      stlutils::at_growing(m_floor_regions, floor).emplace_back(region_idx);
+      auto& grid = m_floor_region_grids[floor];
+      const auto& floor_size = m_floor_sizes[floor];
+      for (int r = std::max(region.bb.top(), 0); r <= std::min(region.bb.bottom(), floor_size.r - 1); ++r)
+        for (int c = std::max(region.bb.left(), 0); c <= std::min(region.bb.right(), floor_size.c - 1); ++c)
+        {
+          int& cell_region_idx = grid[r * floor_size.c + c];
+          if (cell_region_idx == -1 && region.field.is_walkable(region.to_local({ r, c })))
+            cell_region_idx = region_idx;
+        }
+      return region_idx;
+    }
+
+    void attach_portal(int portal_idx, int region_idx)
+    {
+      auto& region = m_regions[region_idx];
+      m_portals[portal_idx].regions.emplace_back(region_idx, stlutils::sizeI(region.portals));
+      region.portals.emplace_back(portal_idx);
+    }
+
+    int add_portal(int floor, const RC& pos)
+    {
+      auto& portal = m_portals.emplace_back();
+      portal.floor = floor;
+      portal.pos = pos;
+      return stlutils::sizeI(m_portals) - 1;
+    }
+
+  public:
+    void clear()
+    {
+      m_regions.clear();
+      m_portals.clear();
+      m_floor_regions.clear();
+      m_floor_region_grids.clear();
+      m_floor_sizes.clear();
+      m_built = false;
+    }
+
+    bool is_built() const { return m_built; }
+
+    // Needs the terrain, so call it after the dungeon has been styled.
+    void build(const Environment& environment)
+    {
+      clear();
+      const int num_floors = environment.num_floors();
+      m_floor_regions.assign(num_floors, {});
+      m_floor_region_grids.resize(num_floors);
+      m_floor_sizes.resize(num_floors);
+      for (int f_idx = 0; f_idx < num_floors; ++f_idx)
+      {
+        m_floor_sizes[f_idx] = environment.get_world_size(f_idx);
+        m_floor_region_grids[f_idx].assign(static_cast<size_t>(m_floor_sizes[f_idx].r) * m_floor_sizes[f_idx].c, -1);
+      }
+      std::map<const BSPNode*, int> room_regions;
+      std::map<const Door*, int> door_portals;
+      auto f_room_region = [&](int floor, BSPNode* room)
+      {
+        auto it = room_regions.find(room);
+        if (it != room_regions.end())
+          return it->second;
+        int region_idx = add_region(floor, room, nullptr, environment);
+        room_regions[room] = region_idx;
+        return region_idx;
+      };
+
+      for (int f_idx = 0; f_idx < num_floors; ++f_idx)
+      {
+        for (const auto& [room_pair, corr] : environment.get_room_corridor_map(f_idx))
+        {
+          f_room_region(f_idx, room_pair.first);
+          f_room_region(f_idx, room_pair.second);
+          int corr_region_idx = add_region(f_idx, nullptr, corr, environment);
+          for (auto* door : corr->doors)
+          {
+            auto it = door_portals.find(door);
+            if (it != door_portals.end())
+            {
+              attach_portal(it->second, corr_region_idx);
+              continue;
+            }
+            int portal_idx = add_portal(f_idx, door->pos);
+            m_portals[portal_idx].door = door;
+            door_portals[door] = portal_idx;
+            attach_portal(portal_idx, corr_region_idx);
+            if (door->room != nullptr)
+              attach_portal(portal_idx, f_room_region(f_idx, door->room));
+          }
+        }
+
+        // Each staircase is listed on both of its floors.
+        for (auto* staircase : environment.fetch_staircases(f_idx))
+        {
+          if (staircase->floor_A != f_idx)
+            continue;
+          int portal_A_idx = add_portal(staircase->floor_A, staircase->pos);
+          int portal_B_idx = add_portal(staircase->floor_B, staircase->pos);
+          m_portals[portal_A_idx].staircase = staircase;
+          m_portals[portal_A_idx].other_end = portal_B_idx;
+          m_portals[portal_B_idx].staircase = staircase;
+          m_portals[portal_B_idx].other_end = portal_A_idx;
+          attach_portal(portal_A_idx, f_room_region(staircase->floor_A, staircase->room_floor_A));
+          attach_portal(portal_B_idx, f_room_region(staircase->floor_B, staircase->room_floor_B));
+        }
+      }
+
+      Scratch scratch;
+      for (auto& region : m_regions)
+      {
+        const int num_portals = stlutils::sizeI(region.portals);
+        region.costs.assign(num_portals * num_portals, -1);
+        for (int p_idx = 0; p_idx < num_portals; ++p_idx)
+        {
+          calc_portal_dists(region, m_portals, m_portals[region.portals[p_idx]].pos, scratch.field, scratch.start_dists);
+          std::copy(scratch.start_dists.begin(), scratch.start_dists.end(), region.costs.begin() + p_idx * num_portals);
+        }
+      }
+      m_built = true;
+    }
+
+    // Returns -1 if pos is not in any room or corridor of the floor.
+    int find_region(int floor, const RC& pos) const
+    {
+      if (!stlutils::in_range(m_floor_region_grids, floor))
+        return -1;
+      const auto& floor_size = m_floor_sizes[floor];
+      if (pos.r < 0 || pos.r >= floor_size.r || pos.c < 0 || pos.c >= floor_size.c)
+        return -1;
+      return m_floor_region_grids[floor][pos.r * floor_size.c + pos.c];
+    }
+
+    // Fills in route with the start, the portals on the way and the goal.
+    // Closed doors are only passed if pass_closed_doors is set.
+    // Returns false if there is no route.
+    bool find_route(int start_floor, const RC& start_pos, int goal_floor, const RC& goal_pos,
+                    std::vector<PathWaypoint>& route, Scratch& scratch, bool pass_closed_doors = false) const
+    {
+      route.clear();
+      int start_region_idx = find_region(start_floor, start_pos);
+      int goal_region_idx = find_region(goal_floor, goal_pos);
+      if (start_region_idx == -1 || goal_region_idx == -1)
+        return false;
+      const auto& start_region = m_regions[start_region_idx];
+      const auto& goal_region = m_regions[goal_region_idx];
+
+      // Nodes are the portals followed by the goal.
+      const int num_portals = stlutils::sizeI(m_portals);
+      const int goal_node = num_portals;
+      const int c_inf = std::numeric_limits<int>::max();
+      auto& g = scratch.g;
+      auto& parent = scratch.parent;
+      auto& via_region = scratch.via_region;
+      auto& closed = scratch.closed;
+      g.assign(num_portals + 1, c_inf);
+      parent.assign(num_portals + 1, -1); // -1 : the start.
+      via_region.assign(num_portals + 1, -1);
+      closed.assign(num_portals + 1, false);
+      using Entry = std::pair<int, int>; // f, node.
+      std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+
+      // Admissible, since the two ends of a staircase are at the same pos.
+      auto f_heuristic = [&](int node)
+      {
+        if (node == goal_node)
+          return 0;
+        const auto& portal = m_portals[node];
+        return std::max(std::abs(portal.pos.r - goal_pos.r), std::abs(portal.pos.c - goal_pos.c))
+          + std::abs(portal.floor - goal_floor) * c_staircase_cost;
+      };
+      auto f_relax = [&](int node, int cost, int from_node, int region_idx)
+      {
+        if (node != goal_node)
+        {
+          const auto* door = m_portals[node].door;
+          if (door != nullptr && !door->open_or_no_door() && !pass_closed_doors)
+            return;
+        }
+        if (cost >= g[node])
+          return;
+        g[node] = cost;
+        parent[node] = from_node;
+        via_region[node] = region_idx;
+        open.emplace(cost + f_heuristic(node), node);
+      };
+
+      auto& goal_dists = scratch.goal_dists;
+      auto& start_dists = scratch.start_dists;
+      calc_portal_dists(goal_region, m_portals, goal_pos, scratch.field, goal_dists);
+      calc_portal_dists(start_region, m_portals, start_pos, scratch.field, start_dists);
+      for (int p_idx = 0; p_idx < stlutils::sizeI(start_region.portals); ++p_idx)
+        if (start_dists[p_idx] >= 0)
+          f_relax(start_region.portals[p_idx], start_dists[p_idx], -1, start_region_idx);
+      if (start_region_idx == goal_region_idx)
+      {
+        compute_field(goal_region, goal_pos, scratch.field);
+        int dist = scratch.field.get_distance(goal_region.to_local(start_pos));
+        if (dist >= 0)
+          f_relax(goal_node, dist, -1, goal_region_idx);
+      }
+
+      while (!open.empty())
+      {
+        int node = open.top().second;
+        open.pop();
+        if (closed[node])
+          continue;
+        closed[node] = true;
+        if (node == goal_node)
+          break;
+        const auto& portal = m_portals[node];
+        for (const auto& [region_idx, local_idx] : portal.regions)
+        {
+          const auto& region = m_regions[region_idx];
+          const int num_region_portals = stlutils::sizeI(region.portals);
+          for (int p_idx = 0; p_idx < num_region_portals; ++p_idx)
+          {
+            int cost = region.costs[local_idx * num_region_portals + p_idx];
+            if (cost > 0)
+              f_relax(region.portals[p_idx], g[node] + cost, node, region_idx);
+          }
+          if (region_idx == goal_region_idx && goal_dists[local_idx] >= 0)
+            f_relax(goal_node, g[node] + goal_dists[local_idx], node, region_idx);
+        }
+        if (portal.other_end != -1)
+          f_relax(portal.other_end, g[node] + c_staircase_cost, node, -1);
+      }
+      if (!closed[goal_node])
+        return false;
+
+      for (int node = goal_node; node != -1; node = parent[node])
+      {
+        if (node == goal_node)
+          route.push_back({ goal_floor, goal_pos, via_region[node] });
+        else
+          route.push_back({ m_portals[node].floor, m_portals[node].pos, via_region[node] });
+      }
+      route.push_back({ start_floor, start_pos, -1 });
+      std::reverse(route.begin(), route.end());
+      return true;
+    }
+
+    // Cells from route[leg_idx - 1] (excluded) to route[leg_idx] (included).
+    // Empty for a leg that takes a staircase. Returns false if the leg cannot be refined.
+    bool refine_leg(const std::vector<PathWaypoint>& route, int leg_idx, std::vector<RC>& cells,
+                    Scratch& scratch) const
+    {
+      cells.clear();
+      if (leg_idx <= 0 || leg_idx >= stlutils::sizeI(route))
+        return false;
+      const auto& from = route[leg_idx - 1];
+      const auto& to = route[leg_idx];
+      if (to.leg_region_idx == -1)
+        return from.pos == to.pos;
+      if (!stlutils::in_range(m_regions, to.leg_region_idx))
+        return false;
+      const auto& region = m_regions[to.leg_region_idx];
+      const auto& field = scratch.field;
+      compute_field(region, to.pos, scratch.field);
+      auto local_pos = region.to_local(from.pos);
+      while (auto step_dir = field.get_step_dir(local_pos))
+      {
+        local_pos += step_dir.value();
+        cells.emplace_back(local_pos + region.bb.pos());
+      }
+      return local_pos == region.to_local(to.pos);
+    }
+
+    // find_route() followed by refine_leg() for all of its legs.
+    // Each cell comes with its floor.
+    bool find_path(int start_floor, const RC& start_pos, int goal_floor, const RC& goal_pos,
+                   std::vector<std::pair<int, RC>>& path, Scratch& scratch, bool pass_closed_doors = false) const
+    {
+      path.clear();
+      std::vector<PathWaypoint> route;
+      if (!find_route(start_floor, start_pos, goal_floor, goal_pos, route, scratch, pass_closed_doors))
+        return false;
+      std::vector<RC> cells;
+      for (int leg_idx = 1; leg_idx < stlutils::sizeI(route); ++leg_idx)
+      {
+        if (!refine_leg(route, leg_idx, cells, scratch))
+          return false;
+        if (route[leg_idx].leg_region_idx == -1)
+          path.emplace_back(route[leg_idx].floor, route[leg_idx].pos);
+        for (const auto& cell : cells)
+          path.emplace_back(route[leg_idx].floor, cell);
+      }
+      return true;
+    }
+  };
+
+}
@@ -151,17 +151,17 @@ namespace dung
     {
       bool can_move_base = true;
       if (weakness > 0)
-        can_move_base = !rnd::one_in(2 + strength - weakness);
+        can_move_base = !rnd_one_in(2 + strength - weakness);
         
       if (can_move_base)
       {
         auto dry_resistance = get_dry_resistance(on_terrain);
         if (dry_resistance.has_value())
-          return rnd::rand() >= dry_resistance.value();
+          return rnd_rand() >= dry_resistance.value();
         
         auto wet_viscosity = get_wet_viscosity(on_terrain);
         if (wet_viscosity.has_value())
-          return rnd::rand() >= wet_viscosity.value();
+          return rnd_rand() >= wet_viscosity.value();
       }
         
       return false;
@@ -274,6 +274,10 @@ namespace dung
     }
     
   protected:
+    // Overridden by entities that draw from a RandomStream of their own.
+    virtual bool rnd_one_in(int n) { return rnd::one_in(n); }
+    virtual float rnd_rand() { return rnd::rand(); }
+    
     void update_los()
     {
       is_moving = false;
@@ -307,10 +311,10 @@ namespace dung
       
       if (is_wet(on_terrain) && can_swim && !can_fly)
       {
-        if (rnd::one_in(endurance) && weakness < strength)
+        if (rnd_one_in(endurance) && weakness < strength)
           weakness++;
         
-        if (rnd::one_in(1 + strength - weakness))
+        if (rnd_one_in(1 + strength - weakness))
           health -= math::roundI(globals::max_health*fluid_damage);
       }
       else if (weight_strain > 0.f)
@@ -319,7 +323,7 @@ namespace dung
       }
       else
       {
-        if (rnd::one_in(2) && 0 < weakness)
+        if (rnd_one_in(2) && 0 < weakness)
           weakness--;
       }
     }
@@ -0,0 +1,105 @@
+//
+//  RandomStream.h
+//  DungGine
+//
+//  Created by Rasmus Anthin on 2026-10-17.
+//
+
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+
+namespace dung
+{
+
+  // Pseudo random number stream of its own (xoshiro128**) for one entity.
+  // Unlike the global rnd:: functions, the outcome does not depend on the order in which
+  //   the entities are updated, so they can be updated on any number of threads.
+  class RandomStream
+  {
+    std::array<uint32_t, 4> m_state { 1, 2, 3, 4 };
+
+    static uint32_t rotl(uint32_t x, int k)
+    {
+      return (x << k) | (x >> (32 - k));
+    }
+
+  public:
+    // splitmix64 expansion of the seed, so that nearby seeds give unrelated streams.
+    void seed(uint64_t seed)
+    {
+      for (size_t i = 0; i < m_state.size(); i += 2)
+      {
+        seed += 0x9E3779B97F4A7C15ull;
+        uint64_t z = seed;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        z = z ^ (z >> 31);
+        m_state[i] = static_cast<uint32_t>(z);
+        m_state[i + 1] = static_cast<uint32_t>(z >> 32);
+      }
+      if (m_state[0] == 0 && m_state[1] == 0 && m_state[2] == 0 && m_state[3] == 0)
+        m_state[0] = 1;
+    }
+
+    uint32_t next()
+    {
+      uint32_t result = rotl(m_state[1] * 5, 7) * 9;
+      uint32_t t = m_state[1] << 9;
+      m_state[2] ^= m_state[0];
+      m_state[3] ^= m_state[1];
+      m_state[1] ^= m_state[2];
+      m_state[0] ^= m_state[3];
+      m_state[2] ^= t;
+      m_state[3] = rotl(m_state[3], 11);
+      return result;
+    }
+
+    // [0, 1).
+    float rand()
+    {
+      return static_cast<float>(next() >> 8) * (1.f / 16777216.f);
+    }
+
+    // [lo, hi].
+    int rand_int(int lo, int hi)
+    {
+      if (hi <= lo)
+        return lo;
+      auto range = static_cast<uint64_t>(static_cast<int64_t>(hi) - lo + 1);
+      return lo + static_cast<int>((static_cast<uint64_t>(next()) * range) >> 32);
+    }
+
+    bool one_in(int n)
+    {
+      return n <= 1 || rand_int(0, n - 1) == 0;
+    }
+
+    // Normal distribution centred in [lo, hi], with the range at three standard deviations.
+    float randn_range(float lo, float hi)
+    {
+      float u1 = std::max(rand(), 1e-7f);
+      float u2 = rand();
+      float n = std::sqrt(-2.f*std::log(u1)) * std::cos(6.2831853f*u2);
+      float val = 0.5f*(lo + hi) + n*(hi - lo)/6.f;
+      return std::clamp(val, std::min(lo, hi), std::max(lo, hi));
+    }
+
+    std::vector<uint32_t> get_state() const
+    {
+      return { m_state.begin(), m_state.end() };
+    }
+
+    void set_state(const std::vector<uint32_t>& state)
+    {
+      if (state.size() != m_state.size())
+        return;
+      std::copy(state.begin(), state.end(), m_state.begin());
+    }
+  };
+
+}
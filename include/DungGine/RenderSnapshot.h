@@ -0,0 +1,175 @@
+//
+//  RenderSnapshot.h
+//  DungGine
+//
+//  Created by Rasmus Anthin on 2026-10-17.
+//
+
+#pragma once
+#include "RoomStyle.h"
+#include "Terrain.h"
+#include "ScreenHelper.h"
+#include "BitPlane.h"
+#include <Termin8or/physics/ParticleSystem.h>
+#include <optional>
+#include <string>
+#include <vector>
+
+
+namespace dung
+{
+
+  struct PCRenderState
+  {
+    RC pos;
+    t8::Glyph glyph;
+    Style style;
+    bool is_spawned = false;
+    Terrain on_terrain = Terrain::Default;
+    bool is_moving = false;
+    float los_r = 0.f;
+    float los_c = 0.f;
+  };
+
+  struct NPCRenderState
+  {
+    RC pos;
+    t8::Glyph glyph;
+    Style style;
+    bool visible = false;
+    Terrain on_terrain = Terrain::Default;
+    int health = 0;
+    bool can_swim = false;
+    bool can_fly = false;
+    float death_time_s = 0.f;
+    bool is_moving = false;
+    float los_r = 0.f;
+    float los_c = 0.f;
+    bool debug = false;
+    float vel_r = 0.f;
+    float vel_c = 0.f;
+    std::optional<RC> room_center; // Only set for debug NPCs.
+    std::optional<RC> corridor_center; // Only set for debug NPCs.
+  };
+
+  // Visible items only, with the shading already applied.
+  struct ItemRenderState
+  {
+    RC pos;
+    t8::Glyph glyph;
+    Color fg_color;
+    Color bg_color;
+  };
+
+  struct DoorRenderState
+  {
+    RC pos;
+    std::string ch;
+    Color bg_color;
+  };
+
+  struct StaircaseRenderState
+  {
+    RC pos;
+    Color fg_color;
+  };
+
+  struct BloodSplatRenderState
+  {
+    RC pos;
+    int shape = 1;
+    bool visible = false;
+    bool alive = false;
+    Terrain terrain = Terrain::Void;
+  };
+
+  // Visible projectiles only.
+  struct ProjectileRenderState
+  {
+    RC pos;
+    t8::Glyph glyph;
+    Color fg_color;
+  };
+
+  // One of the symbols flickering between the PC and an NPC in a melee fight.
+  struct FightRenderState
+  {
+    RC pos;
+    std::string str;
+    Style style;
+  };
+
+  struct InventoryLineRenderState
+  {
+    std::string text;
+    int level = 2; // See InvItem.
+    bool selected = false;
+    bool hilited = false;
+  };
+
+  struct HealthBarRenderState
+  {
+    t8::Glyph glyph;
+    Style style;
+    int health = 0;
+    bool is_pc = false;
+  };
+
+  // What draw() needs of the PC, the NPCs, the items, the doors, the staircases, the HUD
+  //   and the environment on the floor of the PC, copied at the end of DungGine::update().
+  // DungGine keeps three of them: update() writes the back one, draw() reads the front one
+  //   and the latest complete one waits in between until draw() picks it up.
+  // #NOTE: The message box and the debug text box are Termin8or widgets that draw() still
+  //   shares with update(), so messages must not be posted while draw() runs.
+  struct RenderSnapshot
+  {
+    ScreenHelper screen_helper;
+    int curr_floor = 0;
+    
+    // The fog of war and light of the whole floor, and what the rooms are shaded after.
+    BitPlane fog_of_war;
+    BitPlane light;
+    uint64_t fields_generation = 0;
+    bool use_fog_of_war = false;
+    SolarDirection sun_dir = SolarDirection::Nadir;
+    SolarDirectionTable solar_dirs;
+    bool use_per_room_lat_long_for_sun_dir = false;
+    unsigned short texture_anim_ctr = 0;
+    // Per room and corridor draw item of the floor, see Environment::fetch_fully_fogged().
+    std::vector<char> room_fully_fogged;
+    std::vector<char> corridor_fully_fogged;
+    
+    PCRenderState pc;
+    bool pc_has_fire_smoke = false;
+    t8x::ParticleHandler pc_fire_smoke { 500 }; // Only copied while pc_has_fire_smoke.
+    std::vector<NPCRenderState> npcs;
+    std::vector<ItemRenderState> items;
+    std::vector<DoorRenderState> doors;
+    std::vector<StaircaseRenderState> staircases;
+    std::vector<BloodSplatRenderState> blood_splats;
+    std::vector<ProjectileRenderState> projectiles;
+    std::vector<FightRenderState> fights;
+    
+    // HUD
+    std::vector<HealthBarRenderState> health_bars; // The PC first, then the NPCs that it fights.
+    int pc_strength = 0;
+    int pc_weakness = 0;
+    bool show_inventory = false;
+    std::vector<InventoryLineRenderState> inventory_lines; // Only filled in while show_inventory.
+
+    // Keeps the capacity of the vectors.
+    void clear()
+    {
+      npcs.clear();
+      items.clear();
+      doors.clear();
+      staircases.clear();
+      blood_splats.clear();
+      projectiles.clear();
+      fights.clear();
+      health_bars.clear();
+      inventory_lines.clear();
+    }
+  };
+
+}
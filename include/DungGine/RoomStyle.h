@@ -8,6 +8,7 @@
 #pragma once
 #include "SolarMotionPatterns.h"
 #include "DungGineStyles.h"
+#include <Core/StlUtils.h>
 
 namespace dung
 {
@@ -176,4 +177,53 @@ namespace dung
     
   };
   
+  // Room styles looked up by the id of a BSPNode or a Corridor.
+  // Entries are packed in insertion order. The map it replaces iterated in pointer order,
+  //   so callers must not depend on the order of iteration.
+  // #NOTE: The ids are global, but those of one floor form a range of their own,
+  //   so the lookup only spans the ids from the lowest one that is set.
+  template<typename T>
+  class RoomStyleTable
+  {
+    int m_id_offs = 0; // Id of m_entry_idx_by_id[0].
+    std::vector<int> m_entry_idx_by_id; // -1 : no style for this id.
+    std::vector<std::pair<T*, RoomStyle>> m_entries;
+    
+  public:
+    void set(T* obj, const RoomStyle& room_style)
+    {
+      if (m_entry_idx_by_id.empty())
+        m_id_offs = obj->id;
+      else if (obj->id < m_id_offs)
+      {
+        m_entry_idx_by_id.insert(m_entry_idx_by_id.begin(), m_id_offs - obj->id, -1);
+        m_id_offs = obj->id;
+      }
+      const int id_idx = obj->id - m_id_offs;
+      if (id_idx >= stlutils::sizeI(m_entry_idx_by_id))
+        m_entry_idx_by_id.resize(id_idx + 1, -1);
+      auto& entry_idx = m_entry_idx_by_id[id_idx];
+      if (entry_idx == -1)
+      {
+        entry_idx = stlutils::sizeI(m_entries);
+        m_entries.emplace_back(obj, room_style);
+      }
+      else
+        m_entries[entry_idx].second = room_style;
+    }
+    
+    const RoomStyle* find(const T* obj) const
+    {
+      if (obj == nullptr || !stlutils::in_range(m_entry_idx_by_id, obj->id - m_id_offs))
+        return nullptr;
+      auto entry_idx = m_entry_idx_by_id[obj->id - m_id_offs];
+      if (entry_idx == -1)
+        return nullptr;
+      return &m_entries[entry_idx].second;
+    }
+    
+    typename std::vector<std::pair<T*, RoomStyle>>::const_iterator begin() const { return m_entries.cbegin(); }
+    typename std::vector<std::pair<T*, RoomStyle>>::const_iterator end() const { return m_entries.cend(); }
+  };
+  
 }
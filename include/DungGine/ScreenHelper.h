@@ -43,6 +43,22 @@ namespace dung
       return screen_pos + m_screen_in_world.pos();
     }
     
+    // scr_size is the size of the ScreenHandler, i.e. { NR, NC }.
+    // margin grows the screen on all sides, for things drawn around a position.
+    bool is_on_screen(const RC& world_pos, const RC& scr_size, int margin = 0) const
+    {
+      auto scr_pos = get_screen_pos(world_pos);
+      return -margin <= scr_pos.r && scr_pos.r < scr_size.r + margin &&
+        -margin <= scr_pos.c && scr_pos.c < scr_size.c + margin;
+    }
+    
+    bool overlaps_screen(const t8::Rectangle& world_bb, const RC& scr_size) const
+    {
+      auto scr_pos = get_screen_pos(world_bb.pos());
+      return scr_pos.r < scr_size.r && scr_pos.r + world_bb.r_len > 0 &&
+        scr_pos.c < scr_size.c && scr_pos.c + world_bb.c_len > 0;
+    }
+    
     void set_screen_size(const RC& screen_size)
     {
       m_screen_in_world.set_size(screen_size);
@@ -0,0 +1,134 @@
+//
+//  ShadowCasting.h
+//  DungGine
+//
+//  Created by Rasmus Anthin on 2026-10-17.
+//
+
+#pragma once
+#include "BitPlane.h"
+#include <Termin8or/geom/RC.h>
+#include <Termin8or/geom/Rectangle.h>
+
+
+namespace dung
+{
+  using RC = t8::RC;
+  using Rectangle = t8::Rectangle;
+
+  // Textels of a room or corridor that are visible from a point, found by recursive shadowcasting.
+  // Line of sight is invariant to scaling of the axes, so globals::px_aspect
+  //   only affects the shape of the light stencil and not the shadows.
+  // The mask covers the same rectangle as the fog_of_war and light fields of the region.
+  class FovMask
+  {
+    Rectangle m_bb;
+    BitPlane m_visible;
+
+    // Multipliers for transforming the coordinates of the first octant into the other ones.
+    static constexpr int c_oct_xx[8] = { 1, 0, 0, -1, -1, 0, 0, 1 };
+    static constexpr int c_oct_xy[8] = { 0, 1, -1, 0, 0, -1, 1, 0 };
+    static constexpr int c_oct_yx[8] = { 0, 1, 1, 0, 0, -1, -1, 0 };
+    static constexpr int c_oct_yy[8] = { 1, 0, 0, 1, -1, 0, 0, -1 };
+
+    void set_visible(const RC& world_pos)
+    {
+      auto local_pos = world_pos - m_bb.pos();
+      m_visible.set(local_pos.r, local_pos.c, true);
+    }
+
+    template<typename LambdaOpaque>
+    void cast_octant(const RC& origin, int max_dist, int row, float start_slope, float end_slope,
+                     int oct, LambdaOpaque& f_is_opaque)
+    {
+      if (start_slope < end_slope)
+        return;
+      float next_start_slope = start_slope;
+      for (int i = row; i <= max_dist; ++i)
+      {
+        bool blocked = false;
+        int dy = -i;
+        for (int dx = -i; dx <= 0; ++dx)
+        {
+          float l_slope = (dx - 0.5f) / (dy + 0.5f);
+          float r_slope = (dx + 0.5f) / (dy - 0.5f);
+          if (start_slope < r_slope)
+            continue;
+          if (end_slope > l_slope)
+            break;
+
+          RC pos
+          {
+            origin.r + dx*c_oct_yx[oct] + dy*c_oct_yy[oct],
+            origin.c + dx*c_oct_xx[oct] + dy*c_oct_xy[oct]
+          };
+          set_visible(pos);
+
+          bool opaque = !is_inside(pos) || f_is_opaque(pos);
+          if (blocked)
+          {
+            if (opaque)
+              next_start_slope = r_slope;
+            else
+            {
+              blocked = false;
+              start_slope = next_start_slope;
+            }
+          }
+          else if (opaque && i < max_dist)
+          {
+            blocked = true;
+            cast_octant(origin, max_dist, i + 1, start_slope, l_slope, oct, f_is_opaque);
+            next_start_slope = r_slope;
+          }
+        }
+        if (blocked)
+          break;
+      }
+    }
+
+  public:
+    void reset(const Rectangle& bb)
+    {
+      m_bb = bb;
+      m_visible.reset(bb.r_len, bb.c_len);
+    }
+
+    void clear()
+    {
+      m_bb = {};
+      m_visible.clear();
+    }
+
+    bool is_inside(const RC& world_pos) const
+    {
+      auto local_pos = world_pos - m_bb.pos();
+      return 0 <= local_pos.r && local_pos.r < m_bb.r_len && 0 <= local_pos.c && local_pos.c < m_bb.c_len;
+    }
+
+    bool is_visible(const RC& world_pos) const
+    {
+      auto local_pos = world_pos - m_bb.pos();
+      return m_visible.get(local_pos.r, local_pos.c);
+    }
+
+    // Row and column relative to the top left corner of the region.
+    bool is_visible(int local_r, int local_c) const
+    {
+      return m_visible.get(local_r, local_c);
+    }
+
+    const BitPlane& get_plane() const { return m_visible; }
+
+    // f_is_opaque(const RC& world_pos) -> bool. Textels outside of the region are always opaque.
+    // Opaque textels are visible themselves, but shadow the textels behind them.
+    template<typename LambdaOpaque>
+    void cast(const RC& world_origin, int max_dist, LambdaOpaque&& f_is_opaque)
+    {
+      set_visible(world_origin);
+      for (int oct = 0; oct < 8; ++oct)
+        cast_octant(world_origin, max_dist, 1, 1.f, 0.f, oct, f_is_opaque);
+    }
+  };
+
+}
@@ -7,6 +7,7 @@
 
 #pragma once
 #include <Termin8or/drawing/Drawing.h>
+#include <array>
 
 namespace dung
 {
@@ -313,10 +314,16 @@ namespace dung
     
   public:
   
+    // The solar direction only changes when this index changes (for a given season).
+    static int calc_phase_idx(float sun_t)
+    {
+      return static_cast<int>(std::floor(c_num_phases*sun_t));
+    }
+  
     SolarDirection get_solar_direction(Latitude latitude, Longitude longitude, Season season, float sun_t)
     {
       int long_offs = static_cast<int>(longitude);
-      int idx = static_cast<int>(std::floor(c_num_phases*sun_t) + long_offs) % c_num_phases;
+      int idx = (calc_phase_idx(sun_t) + long_offs) % c_num_phases;
       switch (latitude)
       {
         case Latitude::NorthPole:
@@ -397,4 +404,63 @@ namespace dung
     }
   };
   
+  // The solar direction of every latitude and longitude for the current season and solar phase.
+  // Only recomputed when the phase or the season changes, i.e. 16 times per solar day.
+  class SolarDirectionTable
+  {
+    static constexpr int c_num_lat = static_cast<int>(Latitude::NUM_ITEMS);
+    static constexpr int c_num_long = static_cast<int>(Longitude::NUM_ITEMS);
+    
+    std::array<SolarDirection, c_num_lat * c_num_long> m_solar_dirs;
+    int m_phase_idx = -1;
+    Season m_season = Season::NUM_ITEMS;
+    int m_generation = 0; // Bumped whenever the table is recomputed.
+    
+    static int calc_idx(Latitude latitude, Longitude longitude)
+    {
+      return static_cast<int>(latitude) * c_num_long + static_cast<int>(longitude);
+    }
+    
+  public:
+    SolarDirectionTable()
+    {
+      m_solar_dirs.fill(SolarDirection::Nadir);
+    }
+  
+    // Returns true if the table had to be recomputed.
+    bool update(SolarMotionPatterns& solar_motion, Season season, float sun_t)
+    {
+      auto phase_idx = SolarMotionPatterns::calc_phase_idx(sun_t);
+      if (phase_idx == m_phase_idx && season == m_season)
+        return false;
+      m_phase_idx = phase_idx;
+      m_season = season;
+      m_generation++;
+      for (int lat_idx = 0; lat_idx < c_num_lat; ++lat_idx)
+        for (int long_idx = 0; long_idx < c_num_long; ++long_idx)
+        {
+          auto latitude = static_cast<Latitude>(lat_idx);
+          auto longitude = static_cast<Longitude>(long_idx);
+          m_solar_dirs[calc_idx(latitude, longitude)] =
+            solar_motion.get_solar_direction(latitude, longitude, season, sun_t);
+        }
+      return true;
+    }
+    
+    SolarDirection get_solar_direction(Latitude latitude, Longitude longitude) const
+    {
+      auto idx = calc_idx(latitude, longitude);
+      if (idx < 0 || idx >= c_num_lat * c_num_long)
+        return SolarDirection::Nadir;
+      return m_solar_dirs[idx];
+    }
+    
+    bool is_night(Latitude latitude, Longitude longitude) const
+    {
+      return get_solar_direction(latitude, longitude) == SolarDirection::Nadir;
+    }
+    
+    int get_generation() const { return m_generation; }
+  };
+  
 };
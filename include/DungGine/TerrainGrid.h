@@ -0,0 +1,124 @@
+//
+//  TerrainGrid.h
+//  DungGine
+//
+//  Created by Rasmus Anthin on 2026-10-17.
+//
+
+#pragma once
+#include "Terrain.h"
+#include <Termin8or/geom/RC.h>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+
+namespace dung
+{
+  using RC = t8::RC;
+
+  // Terrain id in the five lowest bits and the traversal flags in the three highest bits.
+  class TerrainCell
+  {
+    static constexpr uint8_t c_terrain_mask = 0x1F;
+    static constexpr uint8_t c_dry_bit = 1 << 5;
+    static constexpr uint8_t c_wet_bit = 1 << 6;
+    static constexpr uint8_t c_walkable_bit = 1 << 7;
+
+    uint8_t m_bits = 0;
+
+  public:
+    TerrainCell()
+      : TerrainCell(Terrain::Default)
+    {}
+
+    TerrainCell(Terrain terrain)
+      : m_bits(static_cast<uint8_t>(terrain) & c_terrain_mask)
+    {
+      if (dung::is_dry(terrain))
+        m_bits |= c_dry_bit;
+      if (dung::is_wet(terrain))
+        m_bits |= c_wet_bit;
+      if (dung::allow_move_to(terrain))
+        m_bits |= c_walkable_bit;
+    }
+
+    Terrain get_terrain() const { return static_cast<Terrain>(m_bits & c_terrain_mask); }
+    bool is_dry() const { return (m_bits & c_dry_bit) != 0; }
+    bool is_wet() const { return (m_bits & c_wet_bit) != 0; }
+    bool allow_move_to() const { return (m_bits & c_walkable_bit) != 0; }
+  };
+
+  static_assert(static_cast<int>(Terrain::Rope) <= 0x1F, "Terrain ids no longer fit in TerrainCell!");
+
+  // Dense terrain lookup for one floor. One layer per texture animation frame.
+  class TerrainGrid
+  {
+    RC m_size { 0, 0 };
+    int m_num_layers = 0;
+    std::vector<TerrainCell> m_cells;
+
+    int calc_idx(int layer, const RC& pos) const
+    {
+      return (layer * m_size.r + pos.r) * m_size.c + pos.c;
+    }
+
+  public:
+    void reset(const RC& size, int num_layers)
+    {
+      m_size = size;
+      m_num_layers = std::max(1, num_layers);
+      m_cells.assign(static_cast<size_t>(m_num_layers) * m_size.r * m_size.c, TerrainCell {});
+    }
+
+    void clear()
+    {
+      m_size = { 0, 0 };
+      m_num_layers = 0;
+      m_cells.clear();
+    }
+
+    int num_layers() const { return m_num_layers; }
+
+    bool is_inside(const RC& pos) const
+    {
+      return 0 <= pos.r && pos.r < m_size.r && 0 <= pos.c && pos.c < m_size.c;
+    }
+
+    void set_cell(int layer, const RC& pos, TerrainCell cell)
+    {
+      if (0 <= layer && layer < m_num_layers && is_inside(pos))
+        m_cells[calc_idx(layer, pos)] = cell;
+    }
+
+    // anim_ctr is wrapped to the number of layers.
+    TerrainCell fetch_cell(int anim_ctr, const RC& pos) const
+    {
+      if (m_num_layers == 0 || !is_inside(pos))
+        return {};
+      return m_cells[calc_idx(anim_ctr % m_num_layers, pos)];
+    }
+    
+    // Terrain of the size.r x size.c cells starting at pos, row by row.
+    // Cells outside of the grid get the terrain of a default cell.
+    void fetch_terrain_rect(int anim_ctr, const RC& pos, const RC& size, std::vector<Terrain>& terrain) const
+    {
+      terrain.assign(static_cast<size_t>(std::max(0, size.r)) * std::max(0, size.c), TerrainCell {}.get_terrain());
+      if (m_num_layers == 0)
+        return;
+      int layer = anim_ctr % m_num_layers;
+      int c_start = std::max(0, -pos.c);
+      int c_end = std::min(size.c, m_size.c - pos.c);
+      for (int r = 0; r < size.r; ++r)
+      {
+        int grid_r = pos.r + r;
+        if (grid_r < 0 || grid_r >= m_size.r)
+          continue;
+        const auto* row = &m_cells[calc_idx(layer, { grid_r, 0 })];
+        for (int c = c_start; c < c_end; ++c)
+          terrain[r * size.c + c] = row[pos.c + c].get_terrain();
+      }
+    }
+  };
+
+}
@@ -0,0 +1,121 @@
+//
+//  WorkerPool.h
+//  DungGine
+//
+//  Created by Rasmus Anthin on 2026-10-17.
+//
+
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace dung
+{
+
+  // A fixed set of threads that are kept alive between frames.
+  // parallel_for() hands out the tasks to the workers and to the calling thread
+  //   and returns when all of them are done.
+  // With zero worker threads everything runs on the calling thread.
+  class WorkerPool
+  {
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_cv_work;
+    std::condition_variable m_cv_done;
+    std::function<void(int)> m_task;
+    int m_num_tasks = 0;
+    int m_next_task = 0;
+    int m_num_done = 0;
+    int m_batch = 0; // Bumped by each call to parallel_for().
+    bool m_quit = false;
+
+    // Returns false when there are no more tasks in the current batch.
+    bool run_next_task(std::unique_lock<std::mutex>& lock)
+    {
+      if (m_next_task >= m_num_tasks)
+        return false;
+      int task_idx = m_next_task++;
+      lock.unlock();
+      m_task(task_idx);
+      lock.lock();
+      if (++m_num_done == m_num_tasks)
+        m_cv_done.notify_all();
+      return true;
+    }
+
+    void worker_loop()
+    {
+      int batch = 0;
+      std::unique_lock<std::mutex> lock(m_mutex);
+      while (true)
+      {
+        m_cv_work.wait(lock, [&]() { return m_quit || m_batch != batch; });
+        if (m_quit)
+          return;
+        batch = m_batch;
+        while (run_next_task(lock))
+        {}
+      }
+    }
+
+    void stop()
+    {
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+      }
+      m_cv_work.notify_all();
+      for (auto& thread : m_threads)
+        thread.join();
+      m_threads.clear();
+      m_quit = false;
+    }
+
+  public:
+    WorkerPool() = default;
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+    ~WorkerPool()
+    {
+      stop();
+    }
+
+    void reset(int num_threads)
+    {
+      stop();
+      for (int t_idx = 0; t_idx < num_threads; ++t_idx)
+        m_threads.emplace_back([this]() { worker_loop(); });
+    }
+
+    int num_threads() const { return static_cast<int>(m_threads.size()); }
+
+    // f(int task_idx). Must not call parallel_for() on the same pool.
+    template<typename Lambda>
+    void parallel_for(int num_tasks, Lambda f)
+    {
+      if (m_threads.empty() || num_tasks <= 1)
+      {
+        for (int task_idx = 0; task_idx < num_tasks; ++task_idx)
+          f(task_idx);
+        return;
+      }
+
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_task = f;
+      m_num_tasks = num_tasks;
+      m_next_task = 0;
+      m_num_done = 0;
+      m_batch++;
+      m_cv_work.notify_all();
+      while (run_next_task(lock))
+      {}
+      m_cv_done.wait(lock, [&]() { return m_num_done == m_num_tasks; });
+      m_task = nullptr;
+    }
+  };
+
+}